@@ -5,4 +5,4 @@
 # alsa
 ALIB_LFLAGS="-lasound"
 
-gcc -Wall -O3 -I. main.c x.c ui.c $ALIB_LFLAGS -lm -lfftw3 -lSDL
\ No newline at end of file
+gcc -Wall -O3 -I. -I../biquad -I../resample -I../fir/src main.c x.c ui.c ../biquad/biquad.c ../resample/resample.c ../fir/src/minphase.c $ALIB_LFLAGS -lm -lfftw3 -lSDL -lpthread
\ No newline at end of file
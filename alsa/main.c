@@ -24,15 +24,21 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 #include <sched.h>
 #include <math.h> /* log2 */
 #include <sys/time.h>
 #include <sys/mman.h>
 #include <sys/types.h>
+#include <sys/stat.h>
+#include <pthread.h>
 #include <alsa/asoundlib.h>
 #include <fftw3.h>
 #include "ui.h"
+#include "biquad.h"
+#include "resample.h"
+#include "minphase.h"
 
 
 /* static configuration */
@@ -42,6 +48,20 @@
 #define CONFIG_NCHAN 2
 #define CONFIG_TIMING_CONTROL 0
 #define CONFIG_ENABLE_PLAYBACK 1
+#define CONFIG_ENABLE_IIR 0
+#define CONFIG_IIR_ORDER 4
+#define CONFIG_FIR_MAX_TAPS 1024
+#define CONFIG_FIR_PATH "/tmp/fir_coeffs"
+#define CONFIG_FIR_POLL_MS 200
+#define CONFIG_FIR_CROSSFADE 1
+#define CONFIG_FIR_ZERO_TOL 1e-5
+
+/* the fir and the spectra run at CONFIG_FSAMPL * L / M, the ui only
+   showing up to 8khz. 3 / 8 gives 16537.5hz, and a period of 768
+   samples for 2048. fir kernels are then designed at that rate. */
+#define CONFIG_ENABLE_RESAMPLE 0
+#define CONFIG_RESAMPLE_L 3
+#define CONFIG_RESAMPLE_M 8
 
 
 /* buffer allocation */
@@ -374,15 +394,122 @@ static int setup_sched(void)
 
 /* signal filtering */
 
+/* fir kernels are reloaded at runtime from CONFIG_FIR_PATH, one
+   coefficient per line as printed by fir/src. a loader thread polls the
+   file and prepares the kernel in one of 3 preallocated slots, then
+   publishes it to the audio thread by exchanging the pending pointer.
+   the audio thread takes it at a period start, crossfades from the
+   current kernel over that period, and hands the old slot back through
+   the retired pointer. it never blocks nor allocates: a swap is only
+   delayed while the loader has not collected the previous retired slot.
+   the file should be replaced by a rename, not rewritten in place.
+   with minphase as the third argument, kernels are converted to their
+   minimum phase version when loaded, lowering the filter delay from
+   nh / 2 to a few samples at the same magnitude response.
+ */
+
+/* linear phase kernels are symmetric (types I and II) or antisymmetric
+   (types III and IV). mirrored input pairs are then added or subtracted
+   before the multiply, halving the multiply count. */
+
+#define FIR_SYM_NONE 0
+#define FIR_SYM_EVEN 1
+#define FIR_SYM_ODD 2
+
+/* taps below CONFIG_FIR_ZERO_TOL relative to the largest one are zeroed,
+   under the int16 resolution. half-band kernels are 0 at even offsets
+   from the center but the center, and run with a stride of 2 over the
+   folded pairs, a quarter of the dense multiply count. other kernels
+   with enough zero taps go through the list of nonzero ones. */
+
+#define FIR_SHAPE_DENSE 0
+#define FIR_SHAPE_HALFBAND 1
+#define FIR_SHAPE_SPARSE 2
+
+typedef struct fir_kernel
+{
+  unsigned int nh;
+  unsigned int sym;
+  unsigned int shape;
+
+  /* nonzero tap indices, in the first half if folded */
+  unsigned int nnz;
+  unsigned int inz[CONFIG_FIR_MAX_TAPS];
+
+  double h[CONFIG_FIR_MAX_TAPS];
+} fir_kernel_t;
+
+static unsigned int detect_sym(const fir_kernel_t* k)
+{
+  /* coefficients from a text file are rounded, compare relative to the
+     largest one */
+
+  const double* const h = k->h;
+  const unsigned int nh = k->nh;
+  double tol;
+  unsigned int is_even;
+  unsigned int is_odd;
+  unsigned int i;
+
+  tol = 0;
+  for (i = 0; i != nh; ++i) if (fabs(h[i]) > tol) tol = fabs(h[i]);
+  tol *= 1e-9;
+
+  is_even = 1;
+  is_odd = 1;
+  for (i = 0; i != (nh + 1) / 2; ++i)
+  {
+    if (fabs(h[i] - h[nh - 1 - i]) > tol) is_even = 0;
+    if (fabs(h[i] + h[nh - 1 - i]) > tol) is_odd = 0;
+  }
+
+  /* a zero kernel is both, use the cheaper even one */
+  if (is_even) return FIR_SYM_EVEN;
+  if (is_odd) return FIR_SYM_ODD;
+  return FIR_SYM_NONE;
+}
+
 typedef struct filter_data
 {
   /* fftw data */
+  unsigned int nfft;
   fftw_plan plan;
   fftw_complex* ibuf;
   fftw_complex* obuf;
 
-  /* fir data */
+  /* resampling data. rs_buf the full rate mono input, rs_out the
+     upsampled output, its rs_nout first samples left from the last
+     period when the ratio does not divide it. */
+  resample_t rs_down;
+  resample_t rs_up;
+  double* rs_buf;
+  double* rs_out;
+  unsigned int rs_nout;
+
+  /* fir data. fir_x is the input history of CONFIG_FIR_MAX_TAPS - 1
+     samples followed by the current period, fir_buf and fir_xbuf the
+     current and next kernel outputs. */
+  double* fir_x;
   double* fir_buf;
+  double* fir_xbuf;
+  fir_kernel_t kernels[3];
+  fir_kernel_t* fir_cur;
+
+  /* shared with the loader */
+  fir_kernel_t* fir_pending;
+  fir_kernel_t* fir_retired;
+
+  /* loader data */
+  pthread_t loader;
+  int is_loader;
+  int is_done;
+  const char* fir_path;
+  int is_minphase;
+  fir_kernel_t* fir_free[3];
+  unsigned int nfree;
+
+  /* iir data */
+  biquad_t iir;
 
 } filter_data_t;
 
@@ -406,35 +533,317 @@ static const double fir_coeffs[] =
   -0.131625603115805
 };
 
+/* iir bands, as flo:fhi:gain in util/filter. the default matches the
+   lowpass_6000 fir design. */
+
+static const double iir_bands[][3] =
+{
+  { 6000, CONFIG_FSAMPL / 2, 0 }
+};
+
+static int iir_init(biquad_t* iir)
+{
+  static const unsigned int n = sizeof(iir_bands) / sizeof(iir_bands[0]);
+  unsigned int i;
+
+  if (biquad_init(iir, CONFIG_NCHAN)) return -1;
+
+  for (i = 0; i < n; ++i)
+  {
+    if (biquad_add_band
+	(
+	 iir, CONFIG_FSAMPL,
+	 iir_bands[i][0], iir_bands[i][1], iir_bands[i][2],
+	 CONFIG_IIR_ORDER
+	))
+      return -1;
+  }
+
+  return 0;
+}
+
+static void prepare_fir(fir_kernel_t* k)
+{
+  /* zero tiny taps, then detect symmetry and shape */
+
+  double* const h = k->h;
+  const unsigned int nh = k->nh;
+  const unsigned int nhh = nh / 2;
+  unsigned int npos;
+  unsigned int i;
+  double tol;
+
+  tol = 0;
+  for (i = 0; i != nh; ++i) if (fabs(h[i]) > tol) tol = fabs(h[i]);
+  tol *= CONFIG_FIR_ZERO_TOL;
+  for (i = 0; i != nh; ++i) if (fabs(h[i]) <= tol) h[i] = 0;
+
+  k->sym = detect_sym(k);
+
+  /* the taps the loop goes through */
+  npos = (k->sym == FIR_SYM_NONE) ? nh : nhh;
+
+  k->nnz = 0;
+  for (i = 0; i != npos; ++i) if (h[i] != 0) k->inz[k->nnz++] = i;
+
+  k->shape = FIR_SHAPE_DENSE;
+
+  if ((k->sym == FIR_SYM_EVEN) && (nh & 1) && (nh >= 3) && (h[nhh] != 0))
+  {
+    for (i = (nhh & 1); i < nhh; i += 2) if (h[i] != 0) break ;
+    if (i >= nhh)
+    {
+      k->shape = FIR_SHAPE_HALFBAND;
+      return ;
+    }
+  }
+
+  /* the indirection is not worth it for a few zeros */
+  if ((k->nnz * 4) <= (npos * 3)) k->shape = FIR_SHAPE_SPARSE;
+}
+
+static int load_fir(fir_kernel_t* k, const char* path, int is_minphase)
+{
+  FILE* const file = fopen(path, "r");
+  unsigned int nh;
+  double x;
+  int err = -1;
+
+  if (file == NULL) return -1;
+
+  for (nh = 0; nh != CONFIG_FIR_MAX_TAPS; ++nh)
+  {
+    if (fscanf(file, "%lf", &k->h[nh]) != 1) break ;
+  }
+
+  /* the end must follow, not a parse error nor one more coefficient */
+  if (nh == 0) goto on_error;
+  if (fscanf(file, "%lf", &x) != EOF) goto on_error;
+
+  /* the loader thread is the only one planning after the init */
+  if (is_minphase && minphase(k->h, nh)) goto on_error;
+
+  k->nh = nh;
+  prepare_fir(k);
+  err = 0;
+
+ on_error:
+  fclose(file);
+  return err;
+}
+
+static void* loader_main(void* p)
+{
+  filter_data_t* const data = p;
+  fir_kernel_t* k;
+  struct stat st;
+  struct stat last;
+  int is_changed = 0;
+
+  memset(&last, 0, sizeof(last));
+
+  while (__atomic_load_n(&data->is_done, __ATOMIC_ACQUIRE) == 0)
+  {
+    usleep(CONFIG_FIR_POLL_MS * 1000);
+
+    /* the mtime seconds miss rewrites within the same second, compare
+       the nanoseconds, the size and the inode a rename changes too */
+    if (stat(data->fir_path, &st) == 0)
+    {
+      if ((st.st_mtim.tv_sec != last.st_mtim.tv_sec) ||
+	  (st.st_mtim.tv_nsec != last.st_mtim.tv_nsec) ||
+	  (st.st_size != last.st_size) ||
+	  (st.st_ino != last.st_ino))
+      {
+	last = st;
+	is_changed = 1;
+      }
+    }
+
+    if (is_changed == 0) continue ;
+
+    k = __atomic_exchange_n(&data->fir_retired, NULL, __ATOMIC_ACQUIRE);
+    if (k != NULL) data->fir_free[data->nfree++] = k;
+
+    /* no free slot until the audio thread ends a swap, retry */
+    if (data->nfree == 0) continue ;
+
+    is_changed = 0;
+
+    k = data->fir_free[--data->nfree];
+
+    if (load_fir(k, data->fir_path, data->is_minphase))
+    {
+      printf("invalid fir file: %s\n", data->fir_path);
+      data->fir_free[data->nfree++] = k;
+      continue ;
+    }
+
+    /* a kernel the audio thread has not taken yet is replaced */
+    k = __atomic_exchange_n(&data->fir_pending, k, __ATOMIC_ACQ_REL);
+    if (k != NULL) data->fir_free[data->nfree++] = k;
+  }
+
+  return NULL;
+}
+
+static int fir_init(filter_data_t* data, unsigned int nsampl)
+{
+  static const unsigned int nh = sizeof(fir_coeffs) / sizeof(fir_coeffs[0]);
+  const unsigned int nx = CONFIG_FIR_MAX_TAPS - 1 + nsampl;
+  unsigned int i;
+
+  data->fir_x = calloc(nx, sizeof(double));
+  if (data->fir_x == NULL) goto on_error_0;
+
+  data->fir_buf = malloc(2 * nsampl * sizeof(double));
+  if (data->fir_buf == NULL) goto on_error_1;
+  data->fir_xbuf = data->fir_buf + nsampl;
+
+  /* the buffers are used by the realtime thread */
+  mlock(data->fir_x, nx * sizeof(double));
+  mlock(data->fir_buf, 2 * nsampl * sizeof(double));
+  mlock(data->kernels, sizeof(data->kernels));
+
+  data->kernels[0].nh = nh;
+  for (i = 0; i != nh; ++i) data->kernels[0].h[i] = fir_coeffs[i];
+  if (data->is_minphase && minphase(data->kernels[0].h, nh)) goto on_error_2;
+  prepare_fir(&data->kernels[0]);
+
+  data->fir_cur = &data->kernels[0];
+  data->fir_pending = NULL;
+  data->fir_retired = NULL;
+  data->fir_free[0] = &data->kernels[1];
+  data->fir_free[1] = &data->kernels[2];
+  data->nfree = 2;
+
+  /* created before setup_sched, the loader is not realtime */
+  data->is_done = 0;
+  data->is_loader = 0;
+  if (pthread_create(&data->loader, NULL, loader_main, data) == 0)
+    data->is_loader = 1;
+
+  return 0;
+
+ on_error_2:
+  free(data->fir_buf);
+  data->fir_buf = NULL;
+ on_error_1:
+  free(data->fir_x);
+  data->fir_x = NULL;
+ on_error_0:
+  return -1;
+}
+
+static void fir_fini(filter_data_t* data)
+{
+  if (data->is_loader)
+  {
+    __atomic_store_n(&data->is_done, 1, __ATOMIC_RELEASE);
+    pthread_join(data->loader, NULL);
+  }
+
+  if (data->fir_buf) free(data->fir_buf);
+  if (data->fir_x) free(data->fir_x);
+}
+
+__attribute__((unused)) static int resample_init_data
+(filter_data_t* data, unsigned int nsampl)
+{
+  /* the band width is the same at both rates, for the ui */
+
+  /* cumulated over periods, the up output is never short since both
+     resamplers round their sample count up. the surplus carried to the
+     next period is under m / l + 1. */
+
+  static const unsigned int l = CONFIG_RESAMPLE_L;
+  static const unsigned int m = CONFIG_RESAMPLE_M;
+  unsigned int nout;
+
+  data->nfft = (nsampl * l) / m;
+
+  if (resample_init(&data->rs_down, l, m, 0, nsampl)) goto on_error_0;
+  if (resample_init(&data->rs_up, m, l, 0, data->nfft + 1)) goto on_error_1;
+
+  nout = resample_max_out(&data->rs_up, data->nfft + 1);
+  nout += (m + l - 1) / l + 1;
+  data->rs_buf = malloc((nsampl + nout) * sizeof(double));
+  if (data->rs_buf == NULL) goto on_error_2;
+  mlock(data->rs_buf, (nsampl + nout) * sizeof(double));
+
+  data->rs_out = data->rs_buf + nsampl;
+  data->rs_nout = 0;
+
+  return 0;
+
+ on_error_2:
+  resample_fini(&data->rs_up);
+ on_error_1:
+  resample_fini(&data->rs_down);
+ on_error_0:
+  return -1;
+}
+
+static void resample_fini_data(filter_data_t* data)
+{
+  free(data->rs_buf);
+  resample_fini(&data->rs_up);
+  resample_fini(&data->rs_down);
+}
+
 static int filter_init
 (filter_data_t* data, unsigned int nsampl, unsigned int fband)
 {
+  unsigned int nfir;
+
   data->plan = NULL;
   data->ibuf = NULL;
   data->obuf = NULL;
+  data->rs_buf = NULL;
+  data->fir_x = NULL;
   data->fir_buf = NULL;
+  data->is_loader = 0;
 
-  if (ui_init(nsampl / 2, fband)) goto on_error_0;
+  data->nfft = nsampl;
+  nfir = nsampl;
 
-  data->ibuf = fftw_malloc(nsampl * sizeof(fftw_complex));
-  if (data->ibuf == NULL) goto on_error_0;
+  if (iir_init(&data->iir)) goto on_error_0;
 
-  data->obuf = fftw_malloc(nsampl * sizeof(fftw_complex));
-  if (data->obuf == NULL) goto on_error_1;
+#if CONFIG_ENABLE_RESAMPLE
+  if (resample_init_data(data, nsampl)) goto on_error_0;
+  nfir = resample_max_out(&data->rs_down, nsampl);
+#endif
+
+  if (ui_init(data->nfft / 2, fband)) goto on_error_1;
+
+  data->ibuf = fftw_malloc(data->nfft * sizeof(fftw_complex));
+  if (data->ibuf == NULL) goto on_error_1;
+
+  data->obuf = fftw_malloc(data->nfft * sizeof(fftw_complex));
+  if (data->obuf == NULL) goto on_error_2;
 
   data->plan = fftw_plan_dft_1d
-    (nsampl, data->ibuf, data->obuf, FFTW_FORWARD, FFTW_ESTIMATE);
-  if (data->plan == NULL) goto on_error_2;
+    (data->nfft, data->ibuf, data->obuf, FFTW_FORWARD, FFTW_ESTIMATE);
+  if (data->plan == NULL) goto on_error_3;
 
-  const unsigned int nh = sizeof(fir_coeffs) / sizeof(fir_coeffs[0]);
-  data->fir_buf = malloc((nsampl + nh) * sizeof(double));
+  if (fir_init(data, nfir)) goto on_error_4;
 
   return 0;
 
- on_error_2:
+ on_error_4:
+  fftw_destroy_plan(data->plan);
+  data->plan = NULL;
+ on_error_3:
   fftw_free(data->obuf);
- on_error_1:
+  data->obuf = NULL;
+ on_error_2:
   fftw_free(data->ibuf);
+  data->ibuf = NULL;
+ on_error_1:
+#if CONFIG_ENABLE_RESAMPLE
+  resample_fini_data(data);
+  data->rs_buf = NULL;
+#endif
  on_error_0:
   return -1;
 }
@@ -445,28 +854,22 @@ static void filter_fini(filter_data_t* data)
   if (data->obuf) fftw_free(data->obuf);
   if (data->ibuf) fftw_free(data->ibuf);
 
-  if (data->fir_buf) free(data->fir_buf);
+  if (data->rs_buf) resample_fini_data(data);
+
+  fir_fini(data);
 
   ui_fini();
 }
 
-static void do_power_spectrum
-(filter_data_t* data, const int16_t* buf, unsigned int nsampl)
+static void power_spectrum(filter_data_t* data)
 {
   /* power spectrum a stored in casted data->ibuf */
   double* const x = (double*)data->ibuf;
-  const unsigned int nx = nsampl / 2;
+  const unsigned int nx = data->nfft / 2;
 
   double sum;
   unsigned int i;
 
-  /* convert int16 dual channel into double single channel */
-  for (i = 0; i < nsampl; ++i)
-  {
-    data->ibuf[i][0] = ((double)buf[i * 2 + 0] + (double)buf[i * 2 + 1]) / 2;
-    data->ibuf[i][1] = 0;
-  }
-
   /* real to complex fast fourier transform */
   fftw_execute(data->plan);
 
@@ -491,51 +894,311 @@ static void do_power_spectrum
 #endif
 }
 
-static void convolve
-(
- double* xx, unsigned int nxx,
- const double* x, unsigned int nx,
- const double* h, unsigned int nh
-)
+__attribute__((unused)) static void do_power_spectrum
+(filter_data_t* data, const int16_t* buf, unsigned int nsampl)
+{
+  unsigned int i;
+
+  /* convert int16 dual channel into double single channel */
+  for (i = 0; i < nsampl; ++i)
+  {
+    data->ibuf[i][0] = ((double)buf[i * 2 + 0] + (double)buf[i * 2 + 1]) / 2;
+    data->ibuf[i][1] = 0;
+  }
+
+  power_spectrum(data);
+}
+
+__attribute__((unused)) static void do_power_spectrum_mono
+(filter_data_t* data, const double* x, unsigned int n)
+{
+  /* x the reduced rate signal, zero padded to the plan size */
+
+  unsigned int i;
+
+  if (n > data->nfft) n = data->nfft;
+
+  for (i = 0; i < n; ++i)
+  {
+    data->ibuf[i][0] = x[i];
+    data->ibuf[i][1] = 0;
+  }
+
+  for (; i < data->nfft; ++i)
+  {
+    data->ibuf[i][0] = 0;
+    data->ibuf[i][1] = 0;
+  }
+
+  power_spectrum(data);
+}
+
+static void convolve_sym
+(double* y, const double* x, unsigned int n, const fir_kernel_t* k)
 {
-  int i;
-  int j;
+  /* the middle tap of an odd length antisymmetric kernel is 0 */
 
-  for (i = 0; i < (int)nxx; ++i)
+  const double* const h = k->h;
+  const unsigned int nh = k->nh;
+  const unsigned int nhh = nh / 2;
+  unsigned int i;
+  unsigned int j;
+  double sum;
+
+  for (i = 0; i != n; ++i)
   {
-    xx[i] = 0;
+    const double* const xx = x + (int)i - (int)(nh - 1);
 
-    for (j = 0; j < (int)nh; ++j)
+    sum = 0;
+
+    if (k->sym == FIR_SYM_EVEN)
     {
-      if (i - j < 0) continue ;
-      if (i - j >= nx) continue ;
+      for (j = 0; j != nhh; ++j) sum += h[j] * (xx[nh - 1 - j] + xx[j]);
+      if (nh & 1) sum += h[nhh] * xx[nhh];
+    }
+    else
+    {
+      for (j = 0; j != nhh; ++j) sum += h[j] * (xx[nh - 1 - j] - xx[j]);
+    }
+
+    y[i] = sum;
+  }
+}
+
+static void convolve_halfband
+(double* y, const double* x, unsigned int n, const fir_kernel_t* k)
+{
+  /* odd offsets from the center, folded, plus the center */
+
+  const double* const h = k->h;
+  const unsigned int nh = k->nh;
+  const unsigned int nhh = nh / 2;
+  const unsigned int j0 = (nhh + 1) & 1;
+  unsigned int i;
+  unsigned int j;
+  double sum;
 
-      xx[i] += h[j] * x[i - j];
+  for (i = 0; i != n; ++i)
+  {
+    const double* const xx = x + (int)i - (int)(nh - 1);
+
+    sum = h[nhh] * xx[nhh];
+    for (j = j0; j < nhh; j += 2) sum += h[j] * (xx[nh - 1 - j] + xx[j]);
+
+    y[i] = sum;
+  }
+}
+
+static void convolve_sparse
+(double* y, const double* x, unsigned int n, const fir_kernel_t* k)
+{
+  const double* const h = k->h;
+  const unsigned int* const inz = k->inz;
+  const unsigned int nnz = k->nnz;
+  const unsigned int nh = k->nh;
+  const unsigned int nhh = nh / 2;
+  unsigned int i;
+  unsigned int j;
+  double sum;
+
+  for (i = 0; i != n; ++i)
+  {
+    const double* const xx = x + (int)i - (int)(nh - 1);
+
+    sum = 0;
+
+    if (k->sym == FIR_SYM_EVEN)
+    {
+      for (j = 0; j != nnz; ++j)
+	sum += h[inz[j]] * (xx[nh - 1 - inz[j]] + xx[inz[j]]);
+      if (nh & 1) sum += h[nhh] * xx[nhh];
+    }
+    else if (k->sym == FIR_SYM_ODD)
+    {
+      for (j = 0; j != nnz; ++j)
+	sum += h[inz[j]] * (xx[nh - 1 - inz[j]] - xx[inz[j]]);
+    }
+    else
+    {
+      for (j = 0; j != nnz; ++j)
+	sum += h[inz[j]] * xx[nh - 1 - inz[j]];
     }
+
+    y[i] = sum;
   }
 }
 
-static void do_fir(filter_data_t* data, int16_t* buf, unsigned int nsampl)
+static void convolve
+(double* y, const double* x, unsigned int n, const fir_kernel_t* k)
 {
-  static const unsigned int nh = sizeof(fir_coeffs) / sizeof(fir_coeffs[0]);
+  /* x[-(CONFIG_FIR_MAX_TAPS - 1), n[ the history and input */
 
-  double* const ibuf = (double*)data->ibuf;
+  const double* const h = k->h;
+  const unsigned int nh = k->nh;
+  unsigned int i;
+  unsigned int j;
+  double sum;
 
+  if (k->shape == FIR_SHAPE_HALFBAND)
+  {
+    convolve_halfband(y, x, n, k);
+    return ;
+  }
+
+  if (k->shape == FIR_SHAPE_SPARSE)
+  {
+    convolve_sparse(y, x, n, k);
+    return ;
+  }
+
+  if (k->sym != FIR_SYM_NONE)
+  {
+    convolve_sym(y, x, n, k);
+    return ;
+  }
+
+  for (i = 0; i != n; ++i)
+  {
+    sum = 0;
+    for (j = 0; j != nh; ++j) sum += h[j] * x[(int)i - (int)j];
+    y[i] = sum;
+  }
+}
+
+static void mono_to_int16(int16_t* buf, const double* y, unsigned int n)
+{
+  /* round, saturate and convert back to int16_t dual channel */
+
+  unsigned int i;
+
+  for (i = 0; i < n; ++i)
+  {
+    const double z = floor(y[i] + 0.5);
+    int16_t val;
+    if (z > INT16_MAX) val = INT16_MAX;
+    else if (z < INT16_MIN) val = INT16_MIN;
+    else val = (int16_t)z;
+    buf[i * 2 + 0] = val;
+    buf[i * 2 + 1] = val;
+  }
+}
+
+static void fir_run(filter_data_t* data, unsigned int nsampl)
+{
+  /* filter the nsampl samples after the history into fir_buf */
+
+  static const unsigned int nhist = CONFIG_FIR_MAX_TAPS - 1;
+
+  double* const x = data->fir_x + nhist;
+  double* const y = data->fir_buf;
+  fir_kernel_t* next = NULL;
+  unsigned int i;
+
+  /* take a pending kernel, unless the last retired slot is still
+     there since there is a single retired pointer */
+  if (__atomic_load_n(&data->fir_retired, __ATOMIC_ACQUIRE) == NULL)
+    next = __atomic_exchange_n(&data->fir_pending, NULL, __ATOMIC_ACQUIRE);
+
+#if CONFIG_FIR_CROSSFADE
+  convolve(y, x, nsampl, data->fir_cur);
+
+  if (next != NULL)
+  {
+    /* linear crossfade over the period */
+    convolve(data->fir_xbuf, x, nsampl, next);
+    for (i = 0; i < nsampl; ++i)
+    {
+      const double g = (double)(i + 1) / (double)nsampl;
+      y[i] += g * (data->fir_xbuf[i] - y[i]);
+    }
+  }
+#endif
+
+  if (next != NULL)
+  {
+    __atomic_store_n(&data->fir_retired, data->fir_cur, __ATOMIC_RELEASE);
+    data->fir_cur = next;
+  }
+
+#if (CONFIG_FIR_CROSSFADE == 0)
+  convolve(y, x, nsampl, data->fir_cur);
+#endif
+
+  /* keep the history for the next period */
+  memmove(data->fir_x, data->fir_x + nsampl, nhist * sizeof(double));
+}
+
+__attribute__((unused)) static void do_fir
+(filter_data_t* data, int16_t* buf, unsigned int nsampl)
+{
+  double* const x = data->fir_x + CONFIG_FIR_MAX_TAPS - 1;
   unsigned int i;
 
   /* convert int16 dual channel into double single channel */
   for (i = 0; i < nsampl; ++i)
-    ibuf[i] = ((double)buf[i * 2 + 0] + (double)buf[i * 2 + 1]) / 2;
+    x[i] = ((double)buf[i * 2 + 0] + (double)buf[i * 2 + 1]) / 2;
+
+  fir_run(data, nsampl);
+  mono_to_int16(buf, data->fir_buf, nsampl);
+}
 
-  convolve(data->fir_buf, nsampl + nh, ibuf, nsampl, fir_coeffs, nh);
+__attribute__((unused)) static void do_resampled_fir
+(filter_data_t* data, int16_t* buf, unsigned int nsampl)
+{
+  /* downsample into the fir input, filter and show the spectra at the
+     reduced rate, then upsample back for playback */
+
+  double* const x = data->fir_x + CONFIG_FIR_MAX_TAPS - 1;
+  double* const y = data->rs_buf;
+  unsigned int nr;
+  unsigned int n;
+  unsigned int i;
 
-  /* convert back to int16_t */
   for (i = 0; i < nsampl; ++i)
+    y[i] = ((double)buf[i * 2 + 0] + (double)buf[i * 2 + 1]) / 2;
+
+  nr = resample_run(&data->rs_down, y, nsampl, x);
+
+  do_power_spectrum_mono(data, x, nr);
+  ui_update_ips((double*)data->ibuf, data->nfft / 2);
+
+  fir_run(data, nr);
+
+  do_power_spectrum_mono(data, data->fir_buf, nr);
+  ui_update_ops((double*)data->ibuf, data->nfft / 2);
+
+  /* a non integer ratio period may give a sample more, kept for the
+     next one. the output is never short, the pad is a safety. */
+  n = data->rs_nout;
+  n += resample_run(&data->rs_up, data->fir_buf, nr, data->rs_out + n);
+  for (i = n; i < nsampl; ++i) data->rs_out[i] = 0;
+
+  mono_to_int16(buf, data->rs_out, nsampl);
+
+  data->rs_nout = (n > nsampl) ? (n - nsampl) : 0;
+  for (i = 0; i != data->rs_nout; ++i)
+    data->rs_out[i] = data->rs_out[nsampl + i];
+}
+
+__attribute__((unused)) static void do_iir
+(filter_data_t* data, int16_t* buf, unsigned int nsampl)
+{
+  /* channels are filtered independently, in the same pass */
+
+  double* const x = (double*)data->ibuf;
+  unsigned int i;
+
+  for (i = 0; i < (nsampl * CONFIG_NCHAN); ++i) x[i] = (double)buf[i];
+
+  biquad_run(&data->iir, x, nsampl);
+
+  /* round and saturate */
+  for (i = 0; i < (nsampl * CONFIG_NCHAN); ++i)
   {
-    /* FIXME: double to int16 conversion, not a cast */
-    const int16_t val = (int16_t)data->fir_buf[i];
-    buf[i * 2 + 0] = val;
-    buf[i * 2 + 1] = val;
+    const double y = floor(x[i] + 0.5);
+    if (y > INT16_MAX) buf[i] = INT16_MAX;
+    else if (y < INT16_MIN) buf[i] = INT16_MIN;
+    else buf[i] = (int16_t)y;
   }
 }
 
@@ -549,6 +1212,13 @@ static void filter_apply
   unsigned int i;
   for (i = 0; i < (nsampl * 2); ++i) buf[i] *= 4;
   /* for (i = 0; i < (nsampl * 2); ++i) buf[i] *= 1; */
+#elif CONFIG_ENABLE_RESAMPLE /* fir, at a reduced rate */
+  if (nsampl)
+  {
+    ui_update_begin();
+    do_resampled_fir(data, buf, nsampl);
+    ui_update_end();
+  }
 #elif 1 /* fir */
   if (nsampl)
   {
@@ -557,7 +1227,11 @@ static void filter_apply
     do_power_spectrum(data, buf, nsampl);
     ui_update_ips((double*)data->ibuf, nsampl / 2);
 
+#if CONFIG_ENABLE_IIR
+    do_iir(data, buf, nsampl);
+#else
     do_fir(data, buf, nsampl);
+#endif
     do_power_spectrum(data, buf, nsampl);
     ui_update_ops((double*)data->ibuf, nsampl / 2);
 
@@ -573,6 +1247,8 @@ static void filter_apply
 int main(int ac, char** av)
 {
   const char* const dev_name = ac > 1 ? av[1] : "";
+  const char* const fir_path = ac > 2 ? av[2] : CONFIG_FIR_PATH;
+  const int is_minphase = (ac > 3) && (strcmp(av[3], "minphase") == 0);
 
   snd_pcm_t* idev = NULL;
 
@@ -619,10 +1295,15 @@ int main(int ac, char** av)
 
   printf("nsampl == %u\n", nsampl);
 
+  filter_data.fir_path = fir_path;
+  filter_data.is_minphase = is_minphase;
   if (filter_init(&filter_data, nsampl, fband)) goto  on_error;
 
   if (setup_sched()) goto on_error;
 
+  /* the filters run in this thread */
+  biquad_flush_denormals();
+
   if (open_capture_dev(&idev, dev_name, nsampl)) goto on_error;
 
 #if CONFIG_ENABLE_PLAYBACK
@@ -0,0 +1,313 @@
+#include <string.h>
+#include <math.h>
+#include <sys/types.h>
+#if defined(__SSE__)
+#include <xmmintrin.h>
+#endif
+#include "biquad.h"
+
+
+/* states below this are flushed to 0 after each run. a decaying
+   recursive filter otherwise ends up in denormals, which are slower
+   by orders of magnitude on most cpus. */
+
+#define BIQUAD_DENORMAL_THRESHOLD 1e-30
+
+
+int biquad_init(biquad_t* bq, size_t nchan)
+{
+  if ((nchan == 0) || (nchan > BIQUAD_MAX_CHANNELS)) return -1;
+
+  bq->nsect = 0;
+  bq->nchan = nchan;
+  biquad_reset(bq);
+
+  return 0;
+}
+
+void biquad_reset(biquad_t* bq)
+{
+  memset(bq->z1, 0, sizeof(bq->z1));
+  memset(bq->z2, 0, sizeof(bq->z2));
+}
+
+int biquad_add(biquad_t* bq, const biquad_coeffs_t* c)
+{
+  if (bq->nsect == BIQUAD_MAX_SECTIONS) return -1;
+  bq->coeffs[bq->nsect++] = *c;
+  return 0;
+}
+
+
+/* section design, from the audio eq cookbook (rbj) */
+
+#define BIQUAD_LOWPASS 0
+#define BIQUAD_HIGHPASS 1
+#define BIQUAD_PEAK 2
+#define BIQUAD_NOTCH 3
+#define BIQUAD_LOWSHELF 4
+#define BIQUAD_HIGHSHELF 5
+
+static int add_rbj
+(biquad_t* bq, int type, double fsampl, double f0, double q, double gain)
+{
+  /* gain the linear amplitude gain, for peak and shelves */
+
+  const double w0 = 2.0 * M_PI * f0 / fsampl;
+  const double cw = cos(w0);
+  const double sw = sin(w0);
+  const double a = sqrt(gain);
+  double alpha;
+  double sa;
+  double b[3];
+  double aa[3];
+  biquad_coeffs_t c;
+
+  alpha = sw / (2.0 * q);
+
+  switch (type)
+  {
+  case BIQUAD_LOWPASS:
+    b[0] = (1.0 - cw) / 2.0;
+    b[1] = 1.0 - cw;
+    b[2] = b[0];
+    aa[0] = 1.0 + alpha;
+    aa[1] = -2.0 * cw;
+    aa[2] = 1.0 - alpha;
+    break ;
+
+  case BIQUAD_HIGHPASS:
+    b[0] = (1.0 + cw) / 2.0;
+    b[1] = -(1.0 + cw);
+    b[2] = b[0];
+    aa[0] = 1.0 + alpha;
+    aa[1] = -2.0 * cw;
+    aa[2] = 1.0 - alpha;
+    break ;
+
+  case BIQUAD_PEAK:
+    b[0] = 1.0 + alpha * a;
+    b[1] = -2.0 * cw;
+    b[2] = 1.0 - alpha * a;
+    aa[0] = 1.0 + alpha / a;
+    aa[1] = -2.0 * cw;
+    aa[2] = 1.0 - alpha / a;
+    break ;
+
+  case BIQUAD_NOTCH:
+    b[0] = 1.0;
+    b[1] = -2.0 * cw;
+    b[2] = 1.0;
+    aa[0] = 1.0 + alpha;
+    aa[1] = -2.0 * cw;
+    aa[2] = 1.0 - alpha;
+    break ;
+
+  case BIQUAD_LOWSHELF:
+    sa = 2.0 * sqrt(a) * alpha;
+    b[0] = a * ((a + 1.0) - (a - 1.0) * cw + sa);
+    b[1] = 2.0 * a * ((a - 1.0) - (a + 1.0) * cw);
+    b[2] = a * ((a + 1.0) - (a - 1.0) * cw - sa);
+    aa[0] = (a + 1.0) + (a - 1.0) * cw + sa;
+    aa[1] = -2.0 * ((a - 1.0) + (a + 1.0) * cw);
+    aa[2] = (a + 1.0) + (a - 1.0) * cw - sa;
+    break ;
+
+  case BIQUAD_HIGHSHELF:
+    sa = 2.0 * sqrt(a) * alpha;
+    b[0] = a * ((a + 1.0) + (a - 1.0) * cw + sa);
+    b[1] = -2.0 * a * ((a - 1.0) + (a + 1.0) * cw);
+    b[2] = a * ((a + 1.0) + (a - 1.0) * cw - sa);
+    aa[0] = (a + 1.0) - (a - 1.0) * cw + sa;
+    aa[1] = 2.0 * ((a - 1.0) - (a + 1.0) * cw);
+    aa[2] = (a + 1.0) - (a - 1.0) * cw - sa;
+    break ;
+
+  default:
+    return -1;
+  }
+
+  c.b0 = b[0] / aa[0];
+  c.b1 = b[1] / aa[0];
+  c.b2 = b[2] / aa[0];
+  c.a1 = aa[1] / aa[0];
+  c.a2 = aa[2] / aa[0];
+
+  return biquad_add(bq, &c);
+}
+
+static int add_butterworth
+(biquad_t* bq, int type, double fsampl, double fc, size_t order)
+{
+  /* order / 2 sections with the butterworth pole q, and a bilinear
+     first order section if order is odd */
+
+  const double k = tan(M_PI * fc / fsampl);
+  biquad_coeffs_t c;
+  double q;
+  size_t i;
+
+  for (i = 0; i != order / 2; ++i)
+  {
+    q = 1.0 / (2.0 * sin((double)(2 * i + 1) * M_PI / (double)(2 * order)));
+    if (add_rbj(bq, type, fsampl, fc, q, 1.0)) return -1;
+  }
+
+  if (order & 1)
+  {
+    if (type == BIQUAD_LOWPASS)
+    {
+      c.b0 = k / (k + 1.0);
+      c.b1 = c.b0;
+    }
+    else
+    {
+      c.b0 = 1.0 / (k + 1.0);
+      c.b1 = -c.b0;
+    }
+    c.b2 = 0;
+    c.a1 = (k - 1.0) / (k + 1.0);
+    c.a2 = 0;
+    if (biquad_add(bq, &c)) return -1;
+  }
+
+  return 0;
+}
+
+int biquad_add_band
+(
+ biquad_t* bq, double fsampl,
+ double flo, double fhi, double gain, size_t order
+)
+{
+  /* the flo:fhi:gain spec of util/filter. a band starting at 0 is a
+     low shelf, or a butterworth highpass of the given order if gain
+     is 0. a band ending at nyquist is a high shelf, or a lowpass. any
+     other band is a peak centered on the geometric mean, or
+     (order + 1) / 2 notches if gain is 0. */
+
+  const double fnyq = fsampl / 2.0;
+  const double f0 = sqrt(flo * fhi);
+  biquad_coeffs_t c;
+  size_t i;
+
+  if ((flo < 0) || (flo > fhi) || (fhi > fnyq)) return -1;
+  if (gain < 0) return -1;
+  if (order == 0) order = 1;
+
+  if ((flo <= 0) && (fhi >= fnyq))
+  {
+    /* whole band, a gain */
+    c.b0 = gain;
+    c.b1 = 0;
+    c.b2 = 0;
+    c.a1 = 0;
+    c.a2 = 0;
+    return biquad_add(bq, &c);
+  }
+
+  if (flo <= 0)
+  {
+    if (gain == 0)
+      return add_butterworth(bq, BIQUAD_HIGHPASS, fsampl, fhi, order);
+    return add_rbj(bq, BIQUAD_LOWSHELF, fsampl, fhi, M_SQRT1_2, gain);
+  }
+
+  if (fhi >= fnyq)
+  {
+    if (gain == 0)
+      return add_butterworth(bq, BIQUAD_LOWPASS, fsampl, flo, order);
+    return add_rbj(bq, BIQUAD_HIGHSHELF, fsampl, flo, M_SQRT1_2, gain);
+  }
+
+  if (fhi == flo) return -1;
+
+  if (gain == 0)
+  {
+    for (i = 0; i != (order + 1) / 2; ++i)
+    {
+      if (add_rbj(bq, BIQUAD_NOTCH, fsampl, f0, f0 / (fhi - flo), 1.0))
+	return -1;
+    }
+    return 0;
+  }
+
+  return add_rbj(bq, BIQUAD_PEAK, fsampl, f0, f0 / (fhi - flo), gain);
+}
+
+
+/* cascade processing. sections are applied one after the other over
+   the whole buffer, so that a section state stays in registers. the
+   inner loop is over channels, its count being a constant for common
+   layouts so that the compiler unrolls and vectorizes it.
+ */
+
+static inline void run_sections
+(biquad_t* bq, double* x, size_t n, const size_t nchan)
+{
+  double z1[BIQUAD_MAX_CHANNELS];
+  double z2[BIQUAD_MAX_CHANNELS];
+  double y[BIQUAD_MAX_CHANNELS];
+  double* p;
+  size_t s;
+  size_t i;
+  size_t j;
+
+  for (s = 0; s != bq->nsect; ++s)
+  {
+    const double b0 = bq->coeffs[s].b0;
+    const double b1 = bq->coeffs[s].b1;
+    const double b2 = bq->coeffs[s].b2;
+    const double a1 = bq->coeffs[s].a1;
+    const double a2 = bq->coeffs[s].a2;
+
+    for (j = 0; j != nchan; ++j)
+    {
+      z1[j] = bq->z1[s][j];
+      z2[j] = bq->z2[s][j];
+    }
+
+    for (i = 0, p = x; i != n; ++i, p += nchan)
+    {
+      for (j = 0; j != nchan; ++j)
+      {
+	y[j] = b0 * p[j] + z1[j];
+	z1[j] = b1 * p[j] - a1 * y[j] + z2[j];
+	z2[j] = b2 * p[j] - a2 * y[j];
+	p[j] = y[j];
+      }
+    }
+
+    for (j = 0; j != nchan; ++j)
+    {
+      if (fabs(z1[j]) < BIQUAD_DENORMAL_THRESHOLD) z1[j] = 0;
+      if (fabs(z2[j]) < BIQUAD_DENORMAL_THRESHOLD) z2[j] = 0;
+      bq->z1[s][j] = z1[j];
+      bq->z2[s][j] = z2[j];
+    }
+  }
+}
+
+void biquad_run(biquad_t* bq, double* x, size_t n)
+{
+  /* x the n interleaved frames of nchan samples, filtered in place */
+
+  switch (bq->nchan)
+  {
+  case 1: run_sections(bq, x, n, 1); break ;
+  case 2: run_sections(bq, x, n, 2); break ;
+  case 4: run_sections(bq, x, n, 4); break ;
+  case 8: run_sections(bq, x, n, 8); break ;
+  default: run_sections(bq, x, n, bq->nchan); break ;
+  }
+}
+
+void biquad_flush_denormals(void)
+{
+  /* flush to zero and denormals are zero for the calling thread, so
+     that denormals do not appear within a run either */
+
+#if defined(__SSE__)
+  _mm_setcsr(_mm_getcsr() | 0x8040);
+#endif
+}
@@ -0,0 +1,43 @@
+#ifndef BIQUAD_H_INCLUDED
+# define BIQUAD_H_INCLUDED
+
+#include <sys/types.h>
+
+/* second order section cascade, processing interleaved channels */
+
+#define BIQUAD_MAX_SECTIONS 32
+#define BIQUAD_MAX_CHANNELS 8
+
+typedef struct biquad_coeffs
+{
+  /* normalized, a0 being 1 */
+  double b0;
+  double b1;
+  double b2;
+  double a1;
+  double a2;
+
+} biquad_coeffs_t;
+
+typedef struct biquad
+{
+  size_t nsect;
+  size_t nchan;
+
+  biquad_coeffs_t coeffs[BIQUAD_MAX_SECTIONS];
+
+  /* transposed direct form 2 states, one per channel */
+  double z1[BIQUAD_MAX_SECTIONS][BIQUAD_MAX_CHANNELS];
+  double z2[BIQUAD_MAX_SECTIONS][BIQUAD_MAX_CHANNELS];
+
+} biquad_t;
+
+int biquad_init(biquad_t*, size_t);
+void biquad_reset(biquad_t*);
+int biquad_add(biquad_t*, const biquad_coeffs_t*);
+int biquad_add_band(biquad_t*, double, double, double, double, size_t);
+void biquad_run(biquad_t*, double*, size_t);
+void biquad_flush_denormals(void);
+
+
+#endif /* ! BIQUAD_H_INCLUDED */
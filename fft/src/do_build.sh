@@ -1,5 +1,7 @@
 #!/usr/bin/env sh
-$HOME/install/bin/gmeteor ../../fir/lowpass_6000.gmeteor > /tmp/fu.h ;
+# $HOME/install/bin/gmeteor ../../fir/lowpass_6000.gmeteor > /tmp/fu.h ;
 # gnuplot -e "plot '/tmp/fu.plot'; pause mouse key;" ;
+gcc -Wall -I../../tonegen -o /tmp/fir ../../fir/src/main.c ../../fir/src/remez.c ../../fir/src/minphase.c ../../tonegen/tonegen.c -lm -lfftw3 ;
+/tmp/fir -fsampl 48000 -ntap 16 -band 0:3000:1:1 -band 3500:24000:0:1 > /tmp/fu.h ;
 > /tmp/bar.h < /tmp/fu.h sed ':a;N;$!ba;s/\n/, /g'
 gcc -Wall main.c -lm -lfftw3 ;
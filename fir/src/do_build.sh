@@ -1 +1 @@
-gcc -Wall -I../../tonegen main.c ../../tonegen/tonegen.c -lm -lfftw3
+gcc -Wall -I../../tonegen main.c remez.c minphase.c ../../tonegen/tonegen.c -lm -lfftw3
@@ -5,6 +5,8 @@
 #include <math.h>
 #include <fftw3.h>
 #include "tonegen.h"
+#include "remez.h"
+#include "minphase.h"
 
 
 /* reference: http://www.exstrom.com/journal/sigproc/index.html */
@@ -146,7 +148,7 @@ static void make_blackman_window(double* x, unsigned int nx)
 }
 
 
-static void make_filter_kernel
+__attribute__((unused)) static void make_filter_kernel
 (const double* fresp, unsigned int nx, fftw_complex* kernel)
 {
   /* dsp_smith, p.298 */
@@ -226,6 +228,123 @@ static void make_filter_kernel
 }
 
 
+/* real symmetric kernel design. fresp being real and sampled from 0
+   to nyquist included, the zero phase impulse response is the type I
+   dct of fresp, which fftw computes as a real even transform of half
+   the size of the mirrored complex one, without the imaginary parts.
+   the plan and the window are made once, so that a kernel is cheap to
+   redesign when the band spec changes. the window is remade only when
+   the length changes.
+ */
+
+/* default length, when no length meets the truncation errors */
+#define KERNEL_NTAP 33
+
+typedef struct kernel_design
+{
+  /* fresp size, kernel length (odd) */
+  unsigned int nx;
+  unsigned int nk;
+
+  double* in;
+  double* out;
+  fftw_plan plan;
+
+  /* blackman window, symmetric over nk, allocated for the max */
+  double* win;
+
+} kernel_design_t;
+
+static int kernel_design_set_ntap(kernel_design_t* kd, unsigned int nk)
+{
+  /* a periodic window of nk + 1 points without its first one is
+     symmetric over nk points and has no zero end */
+
+  const double n = (double)(nk + 1);
+  unsigned int i;
+
+  /* the tap count must be odd and fit in the dct output */
+  if (((nk & 1) == 0) || (nk > (2 * kd->nx - 1))) return -1;
+
+  kd->nk = nk;
+
+  for (i = 0; i != nk; ++i)
+  {
+    const double x = (double)(i + 1);
+    kd->win[i] = 0.42 - 0.5 * cos((2.0 * M_PI * x) / n)
+      + 0.08 * cos((4.0 * M_PI * x) / n);
+  }
+
+  return 0;
+}
+
+static int kernel_design_init
+(kernel_design_t* kd, unsigned int nx, unsigned int nk)
+{
+  if (nx < 2) goto on_error_0;
+
+  kd->nx = nx;
+
+  kd->in = fftw_malloc(nx * sizeof(double));
+  if (kd->in == NULL) goto on_error_0;
+
+  kd->out = fftw_malloc(nx * sizeof(double));
+  if (kd->out == NULL) goto on_error_1;
+
+  kd->plan = fftw_plan_r2r_1d
+    (nx, kd->in, kd->out, FFTW_REDFT00, FFTW_MEASURE);
+  if (kd->plan == NULL) goto on_error_2;
+
+  kd->win = malloc((2 * nx - 1) * sizeof(double));
+  if (kd->win == NULL) goto on_error_3;
+
+  if (kernel_design_set_ntap(kd, nk)) goto on_error_4;
+
+  return 0;
+
+ on_error_4:
+  free(kd->win);
+ on_error_3:
+  fftw_destroy_plan(kd->plan);
+ on_error_2:
+  fftw_free(kd->out);
+ on_error_1:
+  fftw_free(kd->in);
+ on_error_0:
+  return -1;
+}
+
+static void kernel_design_fini(kernel_design_t* kd)
+{
+  free(kd->win);
+  fftw_destroy_plan(kd->plan);
+  fftw_free(kd->out);
+  fftw_free(kd->in);
+}
+
+static void kernel_design_run
+(kernel_design_t* kd, const double* fresp, double* kernel)
+{
+  /* kernel the nk taps, centered on nk / 2 */
+
+  const unsigned int nkk = kd->nk / 2;
+  const double scale = 1.0 / (double)(2 * (kd->nx - 1));
+  unsigned int i;
+
+  memcpy(kd->in, fresp, kd->nx * sizeof(double));
+  fftw_execute(kd->plan);
+
+  kernel[nkk] = kd->out[0] * scale * kd->win[nkk];
+
+  for (i = 1; i <= nkk; ++i)
+  {
+    const double x = kd->out[i] * scale;
+    kernel[nkk - i] = x * kd->win[nkk - i];
+    kernel[nkk + i] = x * kd->win[nkk + i];
+  }
+}
+
+
 __attribute__((unused)) static void fft
 (fftw_complex* x, unsigned int nx, double* xx)
 {
@@ -280,6 +399,107 @@ __attribute__((unused)) static void convolve
 }
 
 
+/* kernel truncation. the shortest odd length whose response, from the
+   fft() check, is within the given errors of fresp, transition bands
+   of ftrans around the cuts excluded. the windowed response error does
+   not strictly decrease with the length, so that lengths are scanned
+   upward. each candidate is reported with its cost, the kernel being
+   symmetric: nk multiply accumulates per sample in direct form, and
+   (nk + 1) / 2 multiplies when folded.
+ */
+
+#define KERNEL_MAX_PASS_ERR 0.01
+#define KERNEL_MAX_STOP_ERR 0.01
+#define KERNEL_TRANS_WIDTH 1000
+
+static unsigned int optimize_kernel
+(
+ kernel_design_t* kd, const double* fresp,
+ const double* fcuts, unsigned int ncuts, double fsampl,
+ double max_pass_err, double max_stop_err, double ftrans
+)
+{
+  /* return the kernel length, 0 if none meets the errors. kd is left
+     set to it. */
+
+  /* the check grid matches the fresp one, from 0 to nyquist */
+  const unsigned int nf = 2 * (kd->nx - 1);
+  const double fband = fsampl / (double)nf;
+
+  fftw_complex* const kernel = fftw_malloc(nf * sizeof(fftw_complex));
+  double* const taps = malloc((nf - 1) * sizeof(double));
+  double* const kernel_fresp = malloc(nf / 2 * sizeof(double));
+  unsigned char* const is_trans = malloc(nf / 2 * sizeof(unsigned char));
+
+  double pass_err;
+  double stop_err;
+  double err;
+  unsigned int nk = 0;
+  unsigned int n;
+  unsigned int i;
+  unsigned int j;
+
+  if ((kernel == NULL) || (taps == NULL)) goto on_error;
+  if ((kernel_fresp == NULL) || (is_trans == NULL)) goto on_error;
+
+  for (i = 0; i != nf / 2; ++i)
+  {
+    is_trans[i] = 0;
+    for (j = 0; j != ncuts; ++j)
+    {
+      if (fabs((double)i * fband - fcuts[j]) < (ftrans / 2)) is_trans[i] = 1;
+    }
+  }
+
+  for (n = 3; n < nf; n += 2)
+  {
+    kernel_design_set_ntap(kd, n);
+    kernel_design_run(kd, fresp, taps);
+
+    for (i = 0; i != n; ++i)
+    {
+      kernel[i][0] = taps[i];
+      kernel[i][1] = 0;
+    }
+
+    for (; i != nf; ++i)
+    {
+      kernel[i][0] = 0;
+      kernel[i][1] = 0;
+    }
+
+    /* fft() scales by 2 / nf, for signal amplitudes */
+    fft(kernel, nf, kernel_fresp);
+
+    pass_err = 0;
+    stop_err = 0;
+    for (i = 0; i != nf / 2; ++i)
+    {
+      if (is_trans[i]) continue ;
+      err = fabs(kernel_fresp[i] * (double)nf / 2.0 - fresp[i]);
+      if (fresp[i] != 0) { if (err > pass_err) pass_err = err; }
+      else if (err > stop_err) stop_err = err;
+    }
+
+    printf("# nk %u pass_err %lf stop_err %lf mac %u folded %u\n",
+	   n, pass_err, stop_err, n, (n + 1) / 2);
+
+    if ((pass_err <= max_pass_err) && (stop_err <= max_stop_err))
+    {
+      nk = n;
+      break ;
+    }
+  }
+
+ on_error:
+  if (kernel) fftw_free(kernel);
+  if (taps) free(taps);
+  if (kernel_fresp) free(kernel_fresp);
+  if (is_trans) free(is_trans);
+  return nk;
+}
+
+
 static void do_impulse_response(void)
 {
   static const double fsampl = 48000;
@@ -300,7 +520,55 @@ static void do_impulse_response(void)
   /* make_hipass_fresp(fresp, nbands, fcuts[0], fsampl); */
   /* make_bandpass_fresp(fresp, nbands, fcuts[0], fcuts[1], fsampl); */
   make_multipass_fresp(fresp, nbands, fcuts, ncuts, fsampl);
+
+#if 1
+  {
+    kernel_design_t kd;
+    double* taps;
+    unsigned int nk;
+
+    if (kernel_design_init(&kd, nbands, KERNEL_NTAP)) goto on_error;
+
+    nk = optimize_kernel
+    (
+     &kd, fresp, fcuts, ncuts, fsampl,
+     KERNEL_MAX_PASS_ERR, KERNEL_MAX_STOP_ERR, KERNEL_TRANS_WIDTH
+    );
+
+    if (nk == 0)
+    {
+      printf("# no kernel meets the errors, using %u taps\n", KERNEL_NTAP);
+      nk = KERNEL_NTAP;
+      kernel_design_set_ntap(&kd, nk);
+    }
+
+    taps = malloc(nk * sizeof(double));
+    if (taps == NULL)
+    {
+      kernel_design_fini(&kd);
+      goto on_error;
+    }
+
+    kernel_design_run(&kd, fresp, taps);
+    kernel_design_fini(&kd);
+
+    for (i = 0; i < nk; ++i)
+    {
+      kernel[i][0] = taps[i];
+      kernel[i][1] = 0;
+    }
+
+    free(taps);
+
+    for (; i < nbands * 2; ++i)
+    {
+      kernel[i][0] = 0;
+      kernel[i][1] = 0;
+    }
+  }
+#else
   make_filter_kernel(fresp, nbands, kernel);
+#endif
 
 #if 1
   fft(kernel, nbands * 2, kernel_fresp);
@@ -327,14 +595,117 @@ static void do_impulse_response(void)
   free(obuf);
 #endif
 
+ on_error:
   free(fresp);
   free(kernel);
   free(kernel_fresp);
 }
 
 
+/* equiripple design, from the command line. coefficients are printed
+   one per line, the format expected by fft/src/do_build.sh.
+   -fsampl fs: sampling frequency, default to 48000
+   -band flo:fhi:gain:ripple: a band, repeated in increasing order
+   -ntap n: the kernel length, default to the minimum meeting the spec
+   -minphase 1: convert to minimum phase, trading phase linearity for a
+   lower delay with the same magnitude response
+ */
+
+static int str_to_band(const char* s, remez_band_t* b)
+{
+  double t[4];
+  char* p;
+  size_t i;
+
+  for (i = 0; i != 4; ++i)
+  {
+    t[i] = strtod(s, &p);
+    if (p == s) return -1;
+    if (*p != ((i == 3) ? 0 : ':')) return -1;
+    s = p + 1;
+  }
+
+  b->flo = t[0];
+  b->fhi = t[1];
+  b->gain = t[2];
+  b->ripple = t[3];
+
+  return 0;
+}
+
+static int do_remez(int ac, char** av)
+{
+  remez_band_t bands[REMEZ_MAX_BANDS];
+  size_t nband = 0;
+  double fsampl = 48000;
+  size_t ntap = 0;
+  int is_minphase = 0;
+  double* h;
+  double err;
+  size_t i;
+  int err_res = -1;
+
+  if ((ac & 1) == 0) goto on_error_0;
+
+  for (i = 1; i != (size_t)ac; i += 2)
+  {
+    const char* const k = av[i];
+    const char* const v = av[i + 1];
+
+    if (strcmp(k, "-fsampl") == 0)
+    {
+      fsampl = strtod(v, NULL);
+    }
+    else if (strcmp(k, "-band") == 0)
+    {
+      if (nband == REMEZ_MAX_BANDS) goto on_error_0;
+      if (str_to_band(v, &bands[nband])) goto on_error_0;
+      ++nband;
+    }
+    else if (strcmp(k, "-ntap") == 0)
+    {
+      ntap = (size_t)strtoul(v, NULL, 10);
+    }
+    else if (strcmp(k, "-minphase") == 0)
+    {
+      is_minphase = (int)strtoul(v, NULL, 10);
+    }
+    else goto on_error_0;
+  }
+
+  if (nband == 0) goto on_error_0;
+
+  h = malloc(REMEZ_MAX_TAPS * sizeof(double));
+  if (h == NULL) goto on_error_0;
+
+  if (ntap)
+  {
+    if (remez_design(h, ntap, bands, nband, fsampl, &err)) goto on_error_1;
+  }
+  else
+  {
+    if (remez_min_design(h, &ntap, REMEZ_MAX_TAPS, bands, nband, fsampl))
+      goto on_error_1;
+    remez_design(h, ntap, bands, nband, fsampl, &err);
+  }
+
+  if (is_minphase && minphase(h, ntap)) goto on_error_1;
+
+  for (i = 0; i != ntap; ++i) printf("%.17g\n", h[i]);
+  fprintf(stderr, "ntap %zu, error %lf of the ripple\n", ntap, err);
+
+  err_res = 0;
+
+ on_error_1:
+  free(h);
+ on_error_0:
+  return err_res;
+}
+
+
 int main(int ac, char** av)
 {
+  if (ac > 1) return (do_remez(ac, av) == 0) ? 0 : -1;
   do_impulse_response();
   return 0;
 }
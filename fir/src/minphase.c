@@ -0,0 +1,135 @@
+#include <stdlib.h>
+#include <math.h>
+#include <sys/types.h>
+#include <fftw3.h>
+#include "minphase.h"
+
+
+/* reference: oppenheim, schafer, "discrete-time signal processing",
+   homomorphic deconvolution chapter */
+
+/* the real cepstrum of the kernel is the inverse transform of the log
+   magnitude. folding its anticausal part onto the causal one and going
+   back through the exponential gives the minimum phase kernel of the
+   same magnitude. the cepstrum is infinite, so that the grid is much
+   larger than the kernel to limit its time aliasing. zeros of linear
+   phase kernels are on the unit circle and the magnitude is floored
+   before the log. plans are made here: the caller must not run the
+   fftw planner in another thread at the same time.
+ */
+
+#define MINPHASE_GRID_FACTOR 32
+#define MINPHASE_MIN_GRID 1024
+#define MINPHASE_FLOOR 1e-6
+
+
+int minphase(double* h, size_t nh)
+{
+  /* h the nh coefficients, converted in place */
+
+  fftw_complex* x;
+  fftw_plan fwd;
+  fftw_plan bwd;
+  double mmax;
+  double m;
+  double e;
+  size_t n;
+  size_t i;
+  int err = -1;
+
+  if (nh < 2) return 0;
+
+  for (n = MINPHASE_MIN_GRID; n < (MINPHASE_GRID_FACTOR * nh); n *= 2) ;
+
+  x = fftw_malloc(n * sizeof(fftw_complex));
+  if (x == NULL) goto on_error_0;
+
+  fwd = fftw_plan_dft_1d(n, x, x, FFTW_FORWARD, FFTW_ESTIMATE);
+  if (fwd == NULL) goto on_error_1;
+
+  bwd = fftw_plan_dft_1d(n, x, x, FFTW_BACKWARD, FFTW_ESTIMATE);
+  if (bwd == NULL) goto on_error_2;
+
+  for (i = 0; i != nh; ++i)
+  {
+    x[i][0] = h[i];
+    x[i][1] = 0;
+  }
+
+  for (; i != n; ++i)
+  {
+    x[i][0] = 0;
+    x[i][1] = 0;
+  }
+
+  fftw_execute(fwd);
+
+  /* log magnitude, floored relative to the peak */
+
+  mmax = 0;
+  for (i = 0; i != n; ++i)
+  {
+    m = sqrt(x[i][0] * x[i][0] + x[i][1] * x[i][1]);
+    x[i][0] = m;
+    if (m > mmax) mmax = m;
+  }
+
+  if (mmax == 0) goto on_error_3;
+
+  for (i = 0; i != n; ++i)
+  {
+    m = x[i][0];
+    if (m < (mmax * MINPHASE_FLOOR)) m = mmax * MINPHASE_FLOOR;
+    x[i][0] = log(m);
+    x[i][1] = 0;
+  }
+
+  /* real cepstrum, folded. fftw does not scale, done once here. */
+
+  fftw_execute(bwd);
+
+  for (i = 1; i != n / 2; ++i)
+  {
+    x[i][0] *= 2.0;
+    x[i][1] *= 2.0;
+  }
+
+  for (i = n / 2 + 1; i != n; ++i)
+  {
+    x[i][0] = 0;
+    x[i][1] = 0;
+  }
+
+  for (i = 0; i != n; ++i)
+  {
+    x[i][0] /= (double)n;
+    x[i][1] /= (double)n;
+  }
+
+  /* back to the spectrum, through the complex exponential */
+
+  fftw_execute(fwd);
+
+  for (i = 0; i != n; ++i)
+  {
+    e = exp(x[i][0]);
+    m = x[i][1];
+    x[i][0] = e * cos(m);
+    x[i][1] = e * sin(m);
+  }
+
+  fftw_execute(bwd);
+
+  for (i = 0; i != nh; ++i) h[i] = x[i][0] / (double)n;
+
+  err = 0;
+
+ on_error_3:
+  fftw_destroy_plan(bwd);
+ on_error_2:
+  fftw_destroy_plan(fwd);
+ on_error_1:
+  fftw_free(x);
+ on_error_0:
+  return err;
+}
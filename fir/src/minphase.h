@@ -0,0 +1,11 @@
+#ifndef MINPHASE_H_INCLUDED
+# define MINPHASE_H_INCLUDED
+
+#include <sys/types.h>
+
+/* minimum phase conversion of a fir kernel, same magnitude response */
+
+int minphase(double*, size_t);
+
+
+#endif /* ! MINPHASE_H_INCLUDED */
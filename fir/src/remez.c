@@ -0,0 +1,502 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <sys/types.h>
+#include "remez.h"
+
+
+/* reference: parks, mcclellan, "chebyshev approximation for nonrecursive
+   digital filters with linear phase", ieee trans. circuit theory, 1972 */
+/* reference: rabiner, mcclellan, parks, "fir digital filter design
+   techniques using weighted chebyshev approximation", proc. ieee, 1975 */
+
+/* the amplitude response of a symmetric kernel of n taps is a cosine
+   polynomial P of degree r - 1 in x = cos(w), times cos(w / 2) when n
+   is even. the exchange algorithm finds the r + 1 extremal frequencies
+   where the weighted error alternates with equal magnitude, P being
+   interpolated through them in barycentric form.
+ */
+
+#define REMEZ_GRID_DENSITY 16
+#define REMEZ_MAX_ITER 64
+#define REMEZ_TOLERANCE 1e-3
+
+
+typedef struct remez
+{
+  /* grid frequencies, normalized to [0, 0.5], desired and weight */
+  size_t ngrid;
+  double* f;
+  double* d;
+  double* w;
+
+  /* weighted error on the grid */
+  double* e;
+
+  /* extremal grid indices, and candidates when searching */
+  size_t r;
+  size_t* ext;
+  size_t* cand;
+
+  /* interpolation abscissas, weights and values */
+  double* x;
+  double* ad;
+  double* y;
+  double delta;
+
+} remez_t;
+
+
+static int make_grid
+(remez_t* rz, size_t ntap, const remez_band_t* bands, size_t nband, double fs)
+{
+  /* bands are weighted by the inverse of their ripple, so that the
+     spec holds iff the weighted error is at most 1 */
+
+  const int is_even = ((ntap & 1) == 0);
+  const double df = 0.5 / (double)(REMEZ_GRID_DENSITY * rz->r);
+  double flo;
+  double fhi;
+  double c;
+  size_t npt;
+  size_t i;
+  size_t j;
+
+  rz->ngrid = 0;
+  for (i = 0; i != nband; ++i)
+  {
+    npt = (size_t)((bands[i].fhi - bands[i].flo) / fs / df) + 1;
+    rz->ngrid += npt;
+  }
+
+  if (rz->ngrid <= rz->r) return -1;
+
+  rz->f = malloc(4 * rz->ngrid * sizeof(double));
+  if (rz->f == NULL) return -1;
+  rz->d = rz->f + rz->ngrid;
+  rz->w = rz->d + rz->ngrid;
+  rz->e = rz->w + rz->ngrid;
+
+  rz->ngrid = 0;
+  for (i = 0; i != nband; ++i)
+  {
+    flo = bands[i].flo / fs;
+    fhi = bands[i].fhi / fs;
+
+    /* even lengths are 0 at nyquist, stop just before */
+    if (is_even && (fhi > (0.5 - df))) fhi = 0.5 - df;
+    if (fhi < flo) continue ;
+
+    npt = (size_t)((fhi - flo) / df) + 1;
+
+    for (j = 0; j != npt; ++j)
+    {
+      rz->f[rz->ngrid] = (j == (npt - 1)) ? fhi : (flo + (double)j * df);
+      rz->d[rz->ngrid] = bands[i].gain;
+      rz->w[rz->ngrid] = 1.0 / bands[i].ripple;
+
+      /* even lengths, P being the response divided by cos(w / 2) */
+      if (is_even)
+      {
+	c = cos(M_PI * rz->f[rz->ngrid]);
+	rz->d[rz->ngrid] /= c;
+	rz->w[rz->ngrid] *= c;
+      }
+
+      ++rz->ngrid;
+    }
+  }
+
+  if (rz->ngrid <= rz->r) return -1;
+
+  return 0;
+}
+
+static void bary_weights(double* ad, const double* x, size_t n)
+{
+  /* ad[k] = 1 / prod(x[k] - x[j]), up to a common factor which
+     cancels out in delta and in the interpolation. computed from
+     logarithms, the products over- or underflowing for large n. x
+     is decreasing, so that the product sign is (-1)^k. */
+
+  double lmax;
+  double l;
+  size_t j;
+  size_t k;
+
+  lmax = -HUGE_VAL;
+
+  for (k = 0; k != n; ++k)
+  {
+    l = 0;
+    for (j = 0; j != n; ++j)
+    {
+      if (j != k) l -= log(fabs(x[k] - x[j]));
+    }
+
+    ad[k] = l;
+    if (l > lmax) lmax = l;
+  }
+
+  for (k = 0; k != n; ++k)
+  {
+    ad[k] = exp(ad[k] - lmax);
+    if (k & 1) ad[k] = -ad[k];
+  }
+}
+
+static void compute_params(remez_t* rz)
+{
+  /* delta, then P values at the extremal frequencies */
+
+  const size_t n = rz->r + 1;
+  double num;
+  double den;
+  double s;
+  size_t k;
+
+  for (k = 0; k != n; ++k) rz->x[k] = cos(2.0 * M_PI * rz->f[rz->ext[k]]);
+  bary_weights(rz->ad, rz->x, n);
+
+  num = 0;
+  den = 0;
+  s = 1.0;
+  for (k = 0; k != n; ++k, s = -s)
+  {
+    num += rz->ad[k] * rz->d[rz->ext[k]];
+    den += s * rz->ad[k] / rz->w[rz->ext[k]];
+  }
+
+  rz->delta = num / den;
+
+  s = 1.0;
+  for (k = 0; k != n; ++k, s = -s)
+    rz->y[k] = rz->d[rz->ext[k]] - s * rz->delta / rz->w[rz->ext[k]];
+}
+
+static double eval_p(const remez_t* rz, double f)
+{
+  /* P at normalized frequency f, barycentric interpolation */
+
+  const double x = cos(2.0 * M_PI * f);
+  double num = 0;
+  double den = 0;
+  double c;
+  double dx;
+  size_t k;
+
+  for (k = 0; k != (rz->r + 1); ++k)
+  {
+    dx = x - rz->x[k];
+    if (fabs(dx) < 1e-14) return rz->y[k];
+    c = rz->ad[k] / dx;
+    num += c * rz->y[k];
+    den += c;
+  }
+
+  return num / den;
+}
+
+static size_t find_ext(remez_t* rz, double thresh)
+{
+  /* local extrema of the error at least thresh, consecutive ones of
+     the same sign keeping the largest. return the candidate count. */
+
+  const double* const e = rz->e;
+  const size_t n = rz->ngrid;
+  size_t ncand;
+  size_t i;
+
+  ncand = 0;
+
+  for (i = 0; i != n; ++i)
+  {
+    if (fabs(e[i]) < thresh) continue ;
+
+    if ((i > 0) && ((e[i - 1] * e[i]) > 0) && (fabs(e[i - 1]) > fabs(e[i])))
+      continue ;
+    if ((i < (n - 1)) && ((e[i + 1] * e[i]) > 0) && (fabs(e[i + 1]) >= fabs(e[i])))
+      continue ;
+
+    if (ncand && ((e[rz->cand[ncand - 1]] * e[i]) > 0))
+    {
+      if (fabs(e[i]) > fabs(e[rz->cand[ncand - 1]])) rz->cand[ncand - 1] = i;
+      continue ;
+    }
+
+    rz->cand[ncand++] = i;
+  }
+
+  return ncand;
+}
+
+static void remove_cand(remez_t* rz, size_t* ncand, size_t i)
+{
+  memmove(rz->cand + i, rz->cand + i + 1, (*ncand - i - 1) * sizeof(size_t));
+  --*ncand;
+}
+
+static int update_ext(remez_t* rz)
+{
+  /* new extremal set. extrema under the current delta are ignored,
+     unless it is small enough for rounding to break the alternation.
+     extra ones are removed by increasing magnitude, a removal in the
+     middle also removing the smaller of its 2 neighbors, so that the
+     alternation holds. */
+
+  const double* const e = rz->e;
+  const size_t r = rz->r;
+  size_t ncand;
+  size_t imin;
+  size_t i;
+
+  ncand = find_ext(rz, fabs(rz->delta) * (1.0 - REMEZ_TOLERANCE));
+  if (ncand < (r + 1)) ncand = find_ext(rz, 0);
+  if (ncand < (r + 1)) return -1;
+
+  while (ncand > (r + 1))
+  {
+    imin = 0;
+    for (i = 1; i != ncand; ++i)
+    {
+      if (fabs(e[rz->cand[i]]) < fabs(e[rz->cand[imin]])) imin = i;
+    }
+
+    if ((imin == 0) || (imin == (ncand - 1)) || (ncand == (r + 2)))
+    {
+      /* remove the smaller end */
+      if (fabs(e[rz->cand[0]]) < fabs(e[rz->cand[ncand - 1]]))
+	remove_cand(rz, &ncand, 0);
+      else
+	--ncand;
+      continue ;
+    }
+
+    /* neighbors have the same sign, keep the larger */
+    if (fabs(e[rz->cand[imin - 1]]) < fabs(e[rz->cand[imin + 1]]))
+      remove_cand(rz, &ncand, imin - 1);
+    else
+      remove_cand(rz, &ncand, imin + 1);
+    remove_cand(rz, &ncand, (imin < ncand) ? imin : imin - 1);
+  }
+
+  memcpy(rz->ext, rz->cand, (r + 1) * sizeof(size_t));
+
+  return 0;
+}
+
+int remez_design
+(
+ double* h, size_t ntap,
+ const remez_band_t* bands, size_t nband,
+ double fsampl, double* err
+)
+{
+  /* h the ntap coefficients */
+  /* bands in increasing frequency order, not overlapping */
+  /* err the maximum deviation relative to the band ripple, the
+     design meeting the spec if at most 1 */
+
+  const int is_even = ((ntap & 1) == 0);
+  remez_t rz;
+  double* a;
+  double emax;
+  double m;
+  double c;
+  size_t iter;
+  size_t i;
+  size_t k;
+  int res = -1;
+
+  if ((ntap < 3) || (ntap > REMEZ_MAX_TAPS)) return -1;
+  if ((nband == 0) || (nband > REMEZ_MAX_BANDS)) return -1;
+
+  for (i = 0; i != nband; ++i)
+  {
+    if (bands[i].flo > bands[i].fhi) return -1;
+    if (bands[i].fhi > (fsampl / 2)) return -1;
+    if (bands[i].ripple <= 0) return -1;
+    if (i && (bands[i].flo < bands[i - 1].fhi)) return -1;
+  }
+
+  rz.r = is_even ? (ntap / 2) : ((ntap + 1) / 2);
+
+  if (make_grid(&rz, ntap, bands, nband, fsampl)) goto on_error_0;
+
+  rz.ext = malloc(2 * rz.ngrid * sizeof(size_t));
+  if (rz.ext == NULL) goto on_error_1;
+  rz.cand = rz.ext + rz.ngrid;
+
+  rz.x = malloc(3 * (rz.r + 1) * sizeof(double));
+  if (rz.x == NULL) goto on_error_2;
+  rz.ad = rz.x + rz.r + 1;
+  rz.y = rz.ad + rz.r + 1;
+
+  /* initial guess, evenly spaced over the grid */
+
+  for (k = 0; k != (rz.r + 1); ++k)
+    rz.ext[k] = (k * (rz.ngrid - 1)) / rz.r;
+
+  emax = 0;
+
+  for (iter = 0; iter != REMEZ_MAX_ITER; ++iter)
+  {
+    compute_params(&rz);
+
+    emax = 0;
+    for (i = 0; i != rz.ngrid; ++i)
+    {
+      rz.e[i] = rz.w[i] * (rz.d[i] - eval_p(&rz, rz.f[i]));
+      if (fabs(rz.e[i]) > emax) emax = fabs(rz.e[i]);
+    }
+
+    if ((emax - fabs(rz.delta)) <= (REMEZ_TOLERANCE * emax)) break ;
+
+    if (update_ext(&rz)) break ;
+  }
+
+  /* sample the response at n equispaced frequencies, then inverse
+     transform. the same cosine sum holds for both parities. */
+
+  a = malloc((ntap / 2 + 1) * sizeof(double));
+  if (a == NULL) goto on_error_3;
+
+  for (k = 0; k <= (ntap / 2); ++k)
+  {
+    c = (double)k / (double)ntap;
+    a[k] = eval_p(&rz, c);
+    if (is_even) a[k] *= cos(M_PI * c);
+  }
+
+  m = (double)(ntap - 1) / 2.0;
+
+  for (i = 0; i != ntap; ++i)
+  {
+    c = a[0];
+    for (k = 1; k <= ((ntap - 1) / 2); ++k)
+      c += 2.0 * a[k] * cos(2.0 * M_PI * (double)k * ((double)i - m) / (double)ntap);
+    h[i] = c / (double)ntap;
+  }
+
+  free(a);
+
+  *err = emax;
+  res = 0;
+
+ on_error_3:
+  free(rz.x);
+ on_error_2:
+  free(rz.ext);
+ on_error_1:
+  free(rz.f);
+ on_error_0:
+  return res;
+}
+
+
+/* minimum length */
+
+static int is_even_allowed(const remez_band_t* bands, size_t nband, double fs)
+{
+  /* even lengths are 0 at nyquist */
+  const remez_band_t* const b = &bands[nband - 1];
+  return !((b->fhi >= (fs / 2)) && (b->gain != 0));
+}
+
+size_t remez_estimate(const remez_band_t* bands, size_t nband, double fsampl)
+{
+  /* kaiser formula, from the narrowest transition band and the
+     smallest pass and stop band ripples */
+
+  double df;
+  double d1;
+  double d2;
+  double n;
+  size_t i;
+
+  df = 0.5;
+  for (i = 1; i < nband; ++i)
+  {
+    const double x = (bands[i].flo - bands[i - 1].fhi) / fsampl;
+    if ((x > 0) && (x < df)) df = x;
+  }
+
+  d1 = 1;
+  d2 = 1;
+  for (i = 0; i != nband; ++i)
+  {
+    if (bands[i].gain != 0)
+    {
+      if (bands[i].ripple < d1) d1 = bands[i].ripple;
+    }
+    else
+    {
+      if (bands[i].ripple < d2) d2 = bands[i].ripple;
+    }
+  }
+
+  n = (-20.0 * log10(sqrt(d1 * d2)) - 13.0) / (14.6 * df) + 1.0;
+  if (n < 3) n = 3;
+  if (n > REMEZ_MAX_TAPS) n = REMEZ_MAX_TAPS;
+
+  return (size_t)ceil(n);
+}
+
+static int meets_spec
+(
+ double* h, size_t ntap, size_t maxtap,
+ const remez_band_t* bands, size_t nband, double fsampl
+)
+{
+  double err;
+
+  if ((ntap < 3) || (ntap > maxtap)) return 0;
+  if (((ntap & 1) == 0) && (is_even_allowed(bands, nband, fsampl) == 0))
+    return 0;
+  if (remez_design(h, ntap, bands, nband, fsampl, &err)) return 0;
+  return err <= 1.0;
+}
+
+int remez_min_design
+(
+ double* h, size_t* ntap, size_t maxtap,
+ const remez_band_t* bands, size_t nband, double fsampl
+)
+{
+  /* h the maxtap coefficient buffer, ntap the actual length */
+  /* lengths are searched from the estimate. one parity may meet the
+     spec when the other does not, so that both are tried. */
+
+#define MEETS(__n) meets_spec(h, __n, maxtap, bands, nband, fsampl)
+
+  size_t n;
+
+  if (maxtap > REMEZ_MAX_TAPS) maxtap = REMEZ_MAX_TAPS;
+
+  n = remez_estimate(bands, nband, fsampl);
+  if (n > maxtap) n = maxtap;
+
+  if (MEETS(n) || MEETS(n + 1))
+  {
+    if (MEETS(n) == 0) n += 1;
+
+    while (1)
+    {
+      if (MEETS(n - 1)) n -= 1;
+      else if (MEETS(n - 2)) n -= 2;
+      else break ;
+    }
+  }
+  else
+  {
+    for (n += 2; n <= maxtap; ++n) if (MEETS(n)) break ;
+    if (n > maxtap) return -1;
+  }
+
+  /* h holds the last tried design, redo the selected one */
+  if (MEETS(n) == 0) return -1;
+
+  *ntap = n;
+
+  return 0;
+}
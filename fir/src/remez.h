@@ -0,0 +1,30 @@
+#ifndef REMEZ_H_INCLUDED
+# define REMEZ_H_INCLUDED
+
+#include <sys/types.h>
+
+/* parks mcclellan equiripple linear phase fir design */
+
+#define REMEZ_MAX_BANDS 16
+#define REMEZ_MAX_TAPS 4096
+
+typedef struct remez_band
+{
+  /* edges, in hz */
+  double flo;
+  double fhi;
+
+  /* desired gain, and maximum deviation from it */
+  double gain;
+  double ripple;
+
+} remez_band_t;
+
+int remez_design
+(double*, size_t, const remez_band_t*, size_t, double, double*);
+int remez_min_design
+(double*, size_t*, size_t, const remez_band_t*, size_t, double);
+size_t remez_estimate(const remez_band_t*, size_t, double);
+
+
+#endif /* ! REMEZ_H_INCLUDED */
@@ -0,0 +1,182 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <sys/types.h>
+#include "resample.h"
+
+
+/* reference: crochiere, rabiner, "multirate digital signal processing",
+   prentice hall, 1983 */
+
+/* the input is conceptually upsampled by l with zeros, lowpass filtered
+   and decimated by m. only the outputs kept by the decimation are
+   computed, and only the nonzero inputs enter the product: output
+   position t at the upsampled rate uses phase t % l of the prototype
+   on inputs up to t / l, ntap multiplies per output sample.
+ */
+
+/* the cutoff is placed under the lower nyquist frequency, so that the
+   blackman transition band mostly falls under it */
+#define RESAMPLE_CUTOFF 0.95
+
+
+static unsigned int gcd(unsigned int a, unsigned int b)
+{
+  unsigned int r;
+
+  while (b)
+  {
+    r = a % b;
+    a = b;
+    b = r;
+  }
+
+  return a;
+}
+
+static void make_prototype(resample_t* rs)
+{
+  /* windowed sinc of ntap * l taps at the upsampled rate, with a gain
+     of l compensating the zero insertion */
+
+  const unsigned int l = rs->l;
+  const unsigned int k = rs->ntap;
+  const unsigned int n = k * l;
+  const double c = (double)(n - 1) / 2.0;
+  const double fc = RESAMPLE_CUTOFF * 0.5 / (double)((l > rs->m) ? l : rs->m);
+  unsigned int p;
+  unsigned int j;
+  unsigned int i;
+  double x;
+  double h;
+  double w;
+
+  for (p = 0; p != l; ++p)
+  {
+    for (j = 0; j != k; ++j)
+    {
+      i = j * l + p;
+      x = (double)i - c;
+
+      if (x == 0) h = 2.0 * fc;
+      else h = sin(2.0 * M_PI * fc * x) / (M_PI * x);
+
+      w = 0.42 - 0.5 * cos((2.0 * M_PI * (double)(i + 1)) / (double)(n + 1))
+	+ 0.08 * cos((4.0 * M_PI * (double)(i + 1)) / (double)(n + 1));
+
+      rs->h[p * k + (k - 1 - j)] = (double)l * h * w;
+    }
+  }
+}
+
+int resample_init
+(
+ resample_t* rs,
+ unsigned int l, unsigned int m,
+ unsigned int nzero, unsigned int nmax
+)
+{
+  /* nzero the sinc zero crossings on each side, at the lower rate. 0
+     for RESAMPLE_DEFAULT_NZERO. nmax the largest input block, longer
+     ones being split. */
+
+  unsigned int g;
+  unsigned int n;
+
+  if ((l == 0) || (m == 0) || (nmax == 0)) goto on_error_0;
+
+  g = gcd(l, m);
+  rs->l = l / g;
+  rs->m = m / g;
+
+  if (nzero == 0) nzero = RESAMPLE_DEFAULT_NZERO;
+
+  /* prototype length 2 * nzero * max(l, m), a multiple of l */
+  n = 2 * nzero * ((rs->l > rs->m) ? rs->l : rs->m);
+  rs->ntap = (n + rs->l - 1) / rs->l;
+
+  rs->h = malloc(rs->ntap * rs->l * sizeof(double));
+  if (rs->h == NULL) goto on_error_0;
+
+  rs->nmax = nmax;
+  rs->x = malloc((rs->ntap - 1 + nmax) * sizeof(double));
+  if (rs->x == NULL) goto on_error_1;
+
+  make_prototype(rs);
+  resample_reset(rs);
+
+  return 0;
+
+ on_error_1:
+  free(rs->h);
+ on_error_0:
+  return -1;
+}
+
+void resample_fini(resample_t* rs)
+{
+  free(rs->x);
+  free(rs->h);
+}
+
+void resample_reset(resample_t* rs)
+{
+  memset(rs->x, 0, (rs->ntap - 1) * sizeof(double));
+  rs->t = 0;
+}
+
+unsigned int resample_max_out(const resample_t* rs, unsigned int nx)
+{
+  /* output sample count upper bound for nx input samples */
+  return (unsigned int)(((unsigned long)nx * rs->l) / rs->m) + 1;
+}
+
+static unsigned int run_block
+(resample_t* rs, const double* x, unsigned int nx, double* y)
+{
+  const unsigned int k = rs->ntap;
+  const unsigned long tmax = (unsigned long)nx * rs->l;
+  unsigned int ny;
+  unsigned int i;
+  unsigned int j;
+  double sum;
+
+  memcpy(rs->x + k - 1, x, nx * sizeof(double));
+
+  for (ny = 0; rs->t < tmax; ++ny, rs->t += rs->m)
+  {
+    const double* const h = rs->h + (rs->t % rs->l) * k;
+    const double* const xx = rs->x + rs->t / rs->l;
+
+    sum = 0;
+    for (j = 0; j != k; ++j) sum += h[j] * xx[j];
+    y[ny] = sum;
+  }
+
+  rs->t -= tmax;
+
+  /* keep the last ntap - 1 samples, nx possibly being smaller */
+  for (i = 0; i != (k - 1); ++i) rs->x[i] = rs->x[nx + i];
+
+  return ny;
+}
+
+unsigned int resample_run
+(resample_t* rs, const double* x, unsigned int nx, double* y)
+{
+  /* y holds at least resample_max_out(rs, nx) samples. return the
+     output sample count. no allocation, for realtime use. */
+
+  unsigned int ny = 0;
+  unsigned int n;
+
+  while (nx)
+  {
+    n = (nx < rs->nmax) ? nx : rs->nmax;
+    ny += run_block(rs, x, n, y + ny);
+    x += n;
+    nx -= n;
+  }
+
+  return ny;
+}
@@ -0,0 +1,37 @@
+#ifndef RESAMPLE_H_INCLUDED
+# define RESAMPLE_H_INCLUDED
+
+#include <sys/types.h>
+
+/* polyphase rational resampler, by l / m */
+
+#define RESAMPLE_DEFAULT_NZERO 48
+
+typedef struct resample
+{
+  /* ratio, reduced */
+  unsigned int l;
+  unsigned int m;
+
+  /* taps per phase, and the l phases reversed for a forward product */
+  unsigned int ntap;
+  double* h;
+
+  /* ntap - 1 samples of history, followed by up to nmax input ones */
+  unsigned int nmax;
+  double* x;
+
+  /* next output position at l times the input rate, from the block */
+  unsigned long t;
+
+} resample_t;
+
+int resample_init
+(resample_t*, unsigned int, unsigned int, unsigned int, unsigned int);
+void resample_fini(resample_t*);
+void resample_reset(resample_t*);
+unsigned int resample_max_out(const resample_t*, unsigned int);
+unsigned int resample_run(resample_t*, const double*, unsigned int, double*);
+
+
+#endif /* ! RESAMPLE_H_INCLUDED */
@@ -7,7 +7,16 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/mman.h>
+#include <limits.h>
+#ifdef CSV_CONFIG_ZLIB
+#include <zlib.h>
+#endif /* CSV_CONFIG_ZLIB */
+#ifdef CSV_CONFIG_ZSTD
+#include <pthread.h>
+#include <zstd.h>
+#endif /* CSV_CONFIG_ZSTD */
 #include "csv.h"
+#include "dtoa.h"
 
 
 #ifdef CSV_CONFIG_DEBUG
@@ -23,26 +32,29 @@ typedef struct mapped_file
   uint8_t* base;
   size_t off;
   size_t len;
-} mapped_file_t;
+  struct stat st;
 
-typedef mapped_file_t mapped_line_t;
+  /* base is a decoded buffer, not a mapping */
+  int is_decoded;
+} mapped_file_t;
 
 static int map_file(mapped_file_t* mf, const char* path)
 {
   int error = -1;
-  struct stat st;
   int fd;
 
   fd = open(path, O_RDONLY);
   if (fd == -1) return -1;
 
-  if (fstat(fd, &st) == -1) goto on_error;
+  if (fstat(fd, &mf->st) == -1) goto on_error;
 
-  mf->base = (uint8_t*)mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  mf->base = (uint8_t*)mmap
+    (NULL, mf->st.st_size, PROT_READ, MAP_SHARED, fd, 0);
   if (mf->base == MAP_FAILED) goto on_error;
 
   mf->off = 0;
-  mf->len = st.st_size;
+  mf->len = mf->st.st_size;
+  mf->is_decoded = 0;
 
   /* success */
   error = 0;
@@ -55,185 +67,1764 @@ static int map_file(mapped_file_t* mf, const char* path)
 
 static void unmap_file(mapped_file_t* mf)
 {
-  munmap((void*)mf->base, mf->len);
+  if (mf->is_decoded) free(mf->base);
+  else munmap((void*)mf->base, mf->len);
   mf->base = (uint8_t*)MAP_FAILED;
   mf->len = 0;
 }
 
-static int next_line(mapped_file_t* mf, mapped_line_t* ml)
+
+/* compressed input. gzip and zstd are detected from the magic bytes
+   and decoded in memory, there is no temporary file. zstd frames are
+   independent: when the compressed data are mapped, worker threads
+   decode the next frames ahead into slots while the reader consumes
+   them in order. a pipe, a single frame or gzip data are decoded
+   sequentially.
+ */
+
+#define CSV_DEC_RAW 0
+#define CSV_DEC_GZIP 1
+#define CSV_DEC_ZSTD 2
+
+#define CSV_DEC_INBUF_SIZE (1 << 16)
+#define CSV_DEC_MAX_THREADS 16
+
+#ifdef CSV_CONFIG_ZSTD
+
+#define FRAME_SLOT_EMPTY 0
+#define FRAME_SLOT_BUSY 1
+#define FRAME_SLOT_READY 2
+#define FRAME_SLOT_ERROR 3
+
+typedef struct frame_slot
+{
+  size_t frame;
+  int state;
+
+  /* decoded frame, consumed from off */
+  uint8_t* buf;
+  size_t size;
+  size_t len;
+  size_t off;
+
+} frame_slot_t;
+
+typedef struct frame_pool
+{
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+
+  /* compressed frames, handed out from in_off */
+  const uint8_t* in;
+  size_t in_len;
+  size_t in_off;
+
+  /* next frame to decode, to consume, and frame count once known */
+  size_t next;
+  size_t cur;
+  size_t nframe;
+  int is_end;
+  int is_done;
+
+  pthread_t threads[CSV_DEC_MAX_THREADS];
+  size_t nthread;
+
+  /* frame i decoded in slots[i % nslot] */
+  frame_slot_t slots[CSV_DEC_MAX_THREADS * 2];
+  size_t nslot;
+
+} frame_pool_t;
+
+static int slot_reserve(frame_slot_t* slot, size_t size)
+{
+  uint8_t* buf;
+
+  if (size <= slot->size) return 0;
+
+  buf = realloc(slot->buf, size);
+  if (buf == NULL) return -1;
+  slot->buf = buf;
+  slot->size = size;
+
+  return 0;
+}
+
+static int decode_frame
+(ZSTD_DCtx* dctx, frame_slot_t* slot, const uint8_t* src, size_t n)
+{
+  const unsigned long long fcs = ZSTD_getFrameContentSize(src, n);
+  ZSTD_inBuffer ib;
+  ZSTD_outBuffer ob;
+  size_t err;
+
+  slot->len = 0;
+  slot->off = 0;
+
+  if (fcs == ZSTD_CONTENTSIZE_ERROR) return -1;
+
+  if (fcs != ZSTD_CONTENTSIZE_UNKNOWN)
+  {
+    if (slot_reserve(slot, (size_t)fcs)) return -1;
+    err = ZSTD_decompressDCtx(dctx, slot->buf, (size_t)fcs, src, n);
+    if (ZSTD_isError(err)) return -1;
+    slot->len = err;
+    return 0;
+  }
+
+  /* unknown size, stream into a growing buffer */
+
+  ZSTD_DCtx_reset(dctx, ZSTD_reset_session_only);
+
+  ib.src = src;
+  ib.size = n;
+  ib.pos = 0;
+
+  while (1)
+  {
+    if (slot_reserve(slot, slot->len + ZSTD_DStreamOutSize())) return -1;
+
+    ob.dst = slot->buf;
+    ob.size = slot->size;
+    ob.pos = slot->len;
+
+    err = ZSTD_decompressStream(dctx, &ob, &ib);
+    if (ZSTD_isError(err)) return -1;
+    slot->len = ob.pos;
+
+    /* frame done */
+    if (err == 0) break ;
+    if ((ib.pos == ib.size) && (ob.pos != ob.size)) return -1;
+  }
+
+  return 0;
+}
+
+static void* frame_worker(void* arg)
 {
-  const unsigned char* end = mf->base + mf->len;
-  const unsigned char* p;
-  size_t skipnl = 0;
+  frame_pool_t* const fp = arg;
+  ZSTD_DCtx* const dctx = ZSTD_createDCtx();
+  frame_slot_t* slot = NULL;
+  const uint8_t* src;
+  size_t n;
+  int err;
 
-  ml->off = 0;
-  ml->len = 0;
-  ml->base = mf->base + mf->off;
+  pthread_mutex_lock(&fp->lock);
 
-  for (p = ml->base; p != end; ++p, ++ml->len)
+  while (1)
   {
-    if (*p == '\n')
+    /* wait for a frame and a free slot */
+    while (fp->is_done == 0)
+    {
+      if (fp->is_end == 0)
+      {
+	slot = &fp->slots[fp->next % fp->nslot];
+	if (slot->state == FRAME_SLOT_EMPTY) break ;
+      }
+      pthread_cond_wait(&fp->cond, &fp->lock);
+    }
+
+    if (fp->is_done) break ;
+
+    /* take the next frame */
+
+    src = fp->in + fp->in_off;
+    n = ZSTD_findFrameCompressedSize(src, fp->in_len - fp->in_off);
+
+    slot->frame = fp->next++;
+
+    if ((dctx == NULL) || ZSTD_isError(n))
     {
-      skipnl = 1;
-      break;
+      /* not recoverable, end here */
+      slot->state = FRAME_SLOT_ERROR;
+      fp->is_end = 1;
+      fp->nframe = fp->next;
+      pthread_cond_broadcast(&fp->cond);
+      continue ;
     }
+
+    fp->in_off += n;
+    if (fp->in_off == fp->in_len)
+    {
+      fp->is_end = 1;
+      fp->nframe = fp->next;
+    }
+
+    slot->state = FRAME_SLOT_BUSY;
+    pthread_mutex_unlock(&fp->lock);
+
+    err = decode_frame(dctx, slot, src, n);
+
+    pthread_mutex_lock(&fp->lock);
+    slot->state = err ? FRAME_SLOT_ERROR : FRAME_SLOT_READY;
+    pthread_cond_broadcast(&fp->cond);
   }
 
-  if ((p + skipnl) == ml->base) return -1;
+  pthread_mutex_unlock(&fp->lock);
 
-  /* update offset */
-  mf->off += (p - ml->base) + skipnl;
+  if (dctx != NULL) ZSTD_freeDCtx(dctx);
 
-  return 0;
+  return NULL;
 }
 
-static int next_data_line(mapped_file_t* mf, mapped_line_t* ml)
+static void frame_pool_destroy(frame_pool_t* fp)
 {
-  /* next line containing data */
+  size_t i;
 
-  while (next_line(mf, ml) == 0)
+  pthread_mutex_lock(&fp->lock);
+  fp->is_done = 1;
+  pthread_cond_broadcast(&fp->cond);
+  pthread_mutex_unlock(&fp->lock);
+
+  for (i = 0; i != fp->nthread; ++i) pthread_join(fp->threads[i], NULL);
+
+  for (i = 0; i != fp->nslot; ++i)
   {
-    /* skip empty line */
-    if (ml->len == 0) continue ;
+    if (fp->slots[i].buf != NULL) free(fp->slots[i].buf);
+  }
+
+  pthread_cond_destroy(&fp->cond);
+  pthread_mutex_destroy(&fp->lock);
+  free(fp);
+}
 
-    /* skip comment line */
-    if (ml->base[0] == '#') continue ;
+static frame_pool_t* frame_pool_create(const uint8_t* in, size_t len)
+{
+  frame_pool_t* fp;
+  long ncpu;
+  size_t i;
 
-    return 0;
+  fp = malloc(sizeof(frame_pool_t));
+  if (fp == NULL) return NULL;
+
+  ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+  if (ncpu < 1) ncpu = 1;
+  if (ncpu > CSV_DEC_MAX_THREADS) ncpu = CSV_DEC_MAX_THREADS;
+
+  pthread_mutex_init(&fp->lock, NULL);
+  pthread_cond_init(&fp->cond, NULL);
+
+  fp->in = in;
+  fp->in_len = len;
+  fp->in_off = 0;
+  fp->next = 0;
+  fp->cur = 0;
+  fp->nframe = 0;
+  fp->is_end = (len == 0);
+  fp->is_done = 0;
+
+  fp->nslot = (size_t)ncpu * 2;
+  for (i = 0; i != fp->nslot; ++i)
+  {
+    fp->slots[i].frame = (size_t)-1;
+    fp->slots[i].state = FRAME_SLOT_EMPTY;
+    fp->slots[i].buf = NULL;
+    fp->slots[i].size = 0;
   }
 
-  return -1;
+  for (fp->nthread = 0; fp->nthread != (size_t)ncpu; ++fp->nthread)
+  {
+    if (pthread_create(&fp->threads[fp->nthread], NULL, frame_worker, fp))
+      break ;
+  }
+
+  if (fp->nthread == 0)
+  {
+    frame_pool_destroy(fp);
+    return NULL;
+  }
+
+  return fp;
 }
 
-static int next_col(mapped_line_t* ml)
+static ssize_t frame_pool_read(frame_pool_t* fp, uint8_t* buf, size_t n)
 {
-  if (ml->off == ml->len) return -1;
+  /* frames in order. return 0 at end, -1 on error. */
 
-  for (; ml->off < ml->len; ++ml->off)
+  frame_slot_t* slot;
+
+  pthread_mutex_lock(&fp->lock);
+
+  while (1)
   {
-    if (ml->base[ml->off] == ' ') break;
+    if (fp->is_end && (fp->cur == fp->nframe))
+    {
+      pthread_mutex_unlock(&fp->lock);
+      return 0;
+    }
+
+    slot = &fp->slots[fp->cur % fp->nslot];
+    if ((slot->frame == fp->cur) && (slot->state == FRAME_SLOT_ERROR))
+    {
+      pthread_mutex_unlock(&fp->lock);
+      return -1;
+    }
+
+    if ((slot->frame == fp->cur) && (slot->state == FRAME_SLOT_READY))
+    {
+      if (slot->off != slot->len) break ;
+
+      /* consumed, release for frame cur + nslot */
+      slot->state = FRAME_SLOT_EMPTY;
+      ++fp->cur;
+      pthread_cond_broadcast(&fp->cond);
+      continue ;
+    }
+
+    pthread_cond_wait(&fp->cond, &fp->lock);
   }
 
-  /* skip comma */
-  if (ml->off != ml->len) ++ml->off;
+  pthread_mutex_unlock(&fp->lock);
 
-  return 0;
+  /* a ready slot is not touched by the workers */
+  if (n > (slot->len - slot->off)) n = slot->len - slot->off;
+  memcpy(buf, slot->buf + slot->off, n);
+  slot->off += n;
+
+  return (ssize_t)n;
 }
 
-static size_t get_col_count(mapped_line_t* ml)
+#endif /* CSV_CONFIG_ZSTD */
+
+typedef struct csv_dec
 {
-  size_t col_count;
-  for (col_count = 0; next_col(ml) != -1; ++col_count) ;
-  return col_count;
+  int format;
+
+  /* input, from memory or refilled from fd */
+  int fd;
+  const uint8_t* in;
+  size_t in_off;
+  size_t in_len;
+  uint8_t* inbuf;
+  int is_in_eof;
+
+  /* a whole regular file mapping */
+  void* map;
+  size_t map_len;
+
+#ifdef CSV_CONFIG_ZLIB
+  z_stream zs;
+#endif /* CSV_CONFIG_ZLIB */
+
+#ifdef CSV_CONFIG_ZSTD
+  ZSTD_DCtx* zds;
+  frame_pool_t* frames;
+#endif /* CSV_CONFIG_ZSTD */
+
+} csv_dec_t;
+
+static int get_format(const uint8_t* p, size_t n)
+{
+  if ((n >= 2) && (p[0] == 0x1f) && (p[1] == 0x8b)) return CSV_DEC_GZIP;
+
+  if ((n >= 4) && (p[0] == 0x28) && (p[1] == 0xb5) &&
+      (p[2] == 0x2f) && (p[3] == 0xfd))
+    return CSV_DEC_ZSTD;
+
+  return CSV_DEC_RAW;
 }
 
-static int next_value(mapped_file_t* mf, double* x)
+static int dec_fill(csv_dec_t* dec)
 {
-  char* endptr;
+  /* refill the input buffer from fd, if any */
+
+  ssize_t n;
 
-  if (mf->off >= mf->len) return -1;
+  if (dec->in_off != dec->in_len) return 0;
+  if (dec->is_in_eof) return 0;
 
-  *x = strtod((char*)mf->base + mf->off, &endptr);
+  n = read(dec->fd, dec->inbuf, CSV_DEC_INBUF_SIZE);
+  if (n < 0) return -1;
+  if (n == 0) dec->is_in_eof = 1;
 
-  /* endptr points to the next caracter */
-  mf->off = endptr - (char*)mf->base + 1;
+  dec->in = dec->inbuf;
+  dec->in_off = 0;
+  dec->in_len = (size_t)n;
 
   return 0;
 }
 
+static int dec_init(csv_dec_t* dec)
+{
+  /* the input is set, start the decoder */
 
-/* exported */
+  dec->format = get_format(dec->in + dec->in_off, dec->in_len - dec->in_off);
+
+  if (dec->format == CSV_DEC_GZIP)
+  {
+#ifdef CSV_CONFIG_ZLIB
+    memset(&dec->zs, 0, sizeof(dec->zs));
+    /* 32 for gzip header detection */
+    if (inflateInit2(&dec->zs, 15 + 32) != Z_OK) return -1;
+#else
+    return -1;
+#endif /* CSV_CONFIG_ZLIB */
+  }
+  else if (dec->format == CSV_DEC_ZSTD)
+  {
+#ifdef CSV_CONFIG_ZSTD
+    const size_t n = ZSTD_findFrameCompressedSize(dec->in, dec->in_len);
+
+    if ((dec->fd == -1) && (ZSTD_isError(n) == 0) && (n < dec->in_len))
+    {
+      /* whole input available, decode frames in parallel */
+      dec->frames = frame_pool_create(dec->in, dec->in_len);
+      if (dec->frames == NULL) return -1;
+    }
+    else
+    {
+      dec->zds = ZSTD_createDCtx();
+      if (dec->zds == NULL) return -1;
+    }
+#else
+    return -1;
+#endif /* CSV_CONFIG_ZSTD */
+  }
+
+  return 0;
+}
 
-int csv_load_file(csv_handle_t* csv, const char* path)
+static int dec_open_mem(csv_dec_t* dec, const uint8_t* p, size_t n)
 {
-  mapped_file_t mf;
-  mapped_file_t saved_mf;
-  mapped_line_t ml;
-  int err = -1;
-  size_t cpos;
-  size_t lpos;
+  dec->fd = -1;
+  dec->in = p;
+  dec->in_off = 0;
+  dec->in_len = n;
+  dec->inbuf = NULL;
+  dec->is_in_eof = 1;
+  dec->map = NULL;
+  dec->map_len = 0;
+#ifdef CSV_CONFIG_ZSTD
+  dec->zds = NULL;
+  dec->frames = NULL;
+#endif /* CSV_CONFIG_ZSTD */
+
+  return dec_init(dec);
+}
 
-  if (map_file(&mf, path))
+static int dec_open_fd(csv_dec_t* dec, int fd)
+{
+  /* regular files are mapped, pipes read by chunks */
+
+  struct stat st;
+  void* p;
+
+  if ((fstat(fd, &st) == 0) && S_ISREG(st.st_mode) && st.st_size)
   {
-    CSV_PERROR();
-    goto on_error_0;
+    p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (p != MAP_FAILED)
+    {
+      if (dec_open_mem(dec, p, st.st_size) == 0)
+      {
+	dec->map = p;
+	dec->map_len = st.st_size;
+	return 0;
+      }
+
+      munmap(p, st.st_size);
+      return -1;
+    }
   }
 
-  saved_mf = mf;
+  dec->fd = fd;
+  dec->in = NULL;
+  dec->in_off = 0;
+  dec->in_len = 0;
+  dec->is_in_eof = 0;
+  dec->map = NULL;
+  dec->map_len = 0;
+#ifdef CSV_CONFIG_ZSTD
+  dec->zds = NULL;
+  dec->frames = NULL;
+#endif /* CSV_CONFIG_ZSTD */
+
+  dec->inbuf = malloc(CSV_DEC_INBUF_SIZE);
+  if (dec->inbuf == NULL) return -1;
+
+  /* the first chunk gives the format */
+  if (dec_fill(dec)) goto on_error;
+  if (dec_init(dec)) goto on_error;
 
-  csv->nline = 0;
-  csv->ncol = 0;
-  csv->cols = NULL;
+  return 0;
+
+ on_error:
+  free(dec->inbuf);
+  return -1;
+}
+
+static void dec_close(csv_dec_t* dec)
+{
+#ifdef CSV_CONFIG_ZLIB
+  if (dec->format == CSV_DEC_GZIP) inflateEnd(&dec->zs);
+#endif /* CSV_CONFIG_ZLIB */
 
-  /* get column count */
+#ifdef CSV_CONFIG_ZSTD
+  if (dec->frames != NULL) frame_pool_destroy(dec->frames);
+  if (dec->zds != NULL) ZSTD_freeDCtx(dec->zds);
+#endif /* CSV_CONFIG_ZSTD */
 
-  if (next_data_line(&mf, &ml))
+  if (dec->inbuf != NULL) free(dec->inbuf);
+  if (dec->map != NULL) munmap(dec->map, dec->map_len);
+}
+
+static ssize_t dec_read(csv_dec_t* dec, uint8_t* buf, size_t n)
+{
+  /* read decoded bytes. return 0 at end, -1 on error. */
+
+  size_t i;
+
+  if (dec->format == CSV_DEC_RAW)
   {
-    CSV_PERROR();
-    goto on_error_1;
+    if (dec_fill(dec)) return -1;
+    i = dec->in_len - dec->in_off;
+    if (n > i) n = i;
+    memcpy(buf, dec->in + dec->in_off, n);
+    dec->in_off += n;
+    return (ssize_t)n;
   }
 
-  csv->ncol = get_col_count(&ml);
-  if (csv->ncol == 0) goto on_error_1;
+#ifdef CSV_CONFIG_ZLIB
+  if (dec->format == CSV_DEC_GZIP)
+  {
+    int err;
 
-  /* get line count */
+    dec->zs.next_out = buf;
+    dec->zs.avail_out = n;
 
-  for (csv->nline = 1; next_data_line(&mf, &ml) == 0; ++csv->nline) ;
+    while (dec->zs.avail_out == n)
+    {
+      if (dec_fill(dec)) return -1;
+      if (dec->in_off == dec->in_len) break ;
 
-  csv->cols = malloc(csv->nline * csv->ncol * sizeof(double));
-  if (csv->cols == NULL)
+      i = dec->in_len - dec->in_off;
+      dec->zs.next_in = (Bytef*)dec->in + dec->in_off;
+      dec->zs.avail_in = i;
+
+      err = inflate(&dec->zs, Z_NO_FLUSH);
+
+      dec->in_off = dec->in_len - dec->zs.avail_in;
+
+      /* concatenated members */
+      if (err == Z_STREAM_END) err = inflateReset(&dec->zs);
+      else if ((err == Z_BUF_ERROR) && (dec->zs.avail_in == i)) return -1;
+      if ((err != Z_OK) && (err != Z_BUF_ERROR)) return -1;
+    }
+
+    return (ssize_t)(n - dec->zs.avail_out);
+  }
+#endif /* CSV_CONFIG_ZLIB */
+
+#ifdef CSV_CONFIG_ZSTD
+  if (dec->frames != NULL) return frame_pool_read(dec->frames, buf, n);
+
+  if (dec->format == CSV_DEC_ZSTD)
   {
-    CSV_PERROR();
-    goto on_error_1;
+    ZSTD_inBuffer ib;
+    ZSTD_outBuffer ob;
+    size_t err;
+
+    ob.dst = buf;
+    ob.size = n;
+    ob.pos = 0;
+
+    while (ob.pos == 0)
+    {
+      if (dec_fill(dec)) return -1;
+      if (dec->in_off == dec->in_len) break ;
+
+      ib.src = dec->in;
+      ib.size = dec->in_len;
+      ib.pos = dec->in_off;
+
+      err = ZSTD_decompressStream(dec->zds, &ob, &ib);
+      if (ZSTD_isError(err)) return -1;
+
+      dec->in_off = ib.pos;
+    }
+
+    return (ssize_t)ob.pos;
   }
+#endif /* CSV_CONFIG_ZSTD */
 
-  /* get values */
+  return -1;
+}
+
+static int decode_file(mapped_file_t* mf)
+{
+  /* replace a compressed mapping by the decoded data */
+
+  csv_dec_t dec;
+  uint8_t* buf;
+  uint8_t* tmp;
+  size_t size;
+  size_t len;
+  ssize_t n;
+
+  if (get_format(mf->base, mf->len) == CSV_DEC_RAW) return 0;
+
+  if (dec_open_mem(&dec, mf->base, mf->len)) return -1;
+
+  size = mf->len * 4 + 1;
+  buf = malloc(size);
+  if (buf == NULL) goto on_error;
 
-  mf = saved_mf;
-  for (lpos = 0; next_data_line(&mf, &ml) == 0; ++lpos)
+  len = 0;
+  while (1)
   {
-    for (cpos = 0; cpos != csv->ncol; ++cpos)
+    if ((size - len) < CSV_DEC_INBUF_SIZE)
     {
-      double* const x = csv->cols + cpos * csv->nline + lpos;
-      if (next_value(&ml, x))
-      {
-	CSV_PERROR();
-	goto on_error_2;
-      }
+      tmp = realloc(buf, size * 2);
+      if (tmp == NULL) goto on_error;
+      buf = tmp;
+      size *= 2;
     }
+
+    /* keep one byte for a terminating 0 */
+    n = dec_read(&dec, buf + len, size - len - 1);
+    if (n < 0) goto on_error;
+    if (n == 0) break ;
+    len += (size_t)n;
   }
 
-  /* success */
+  buf[len] = 0;
 
-  err = 0;
+  dec_close(&dec);
+  unmap_file(mf);
 
- on_error_2:
-  if (err) free(csv->cols);
- on_error_1:
-  unmap_file(&mf);
- on_error_0:
-  return err;
+  mf->base = buf;
+  mf->off = 0;
+  mf->len = len;
+  mf->is_decoded = 1;
+
+  return 0;
+
+ on_error:
+  if (buf != NULL) free(buf);
+  dec_close(&dec);
+  return -1;
 }
 
-int csv_close(csv_handle_t* csv)
+
+/* structural index. a first pass locates the newline, comment and
+   delimiter characters using simd compares, and the value parser then
+   walks these offsets instead of the bytes. the index is built by
+   chunks ending on a line boundary. runs of delimiters are collapsed,
+   '#' comments the remaining of a line. the end of the data acts as a
+   newline.
+ */
+
+#define CSV_TOK_CHUNK_SIZE (1 << 16)
+#define CSV_DEFAULT_DELIMS " \t,"
+
+typedef struct csv_tok
 {
-  /* may be null if no lines */
-  if (csv->cols != NULL) free(csv->cols);
+  /* data, indexed up to off */
+  const uint8_t* base;
+  size_t len;
+  size_t off;
+
+  /* current chunk start, next line start */
+  size_t chunk_off;
+  size_t cur;
+
+  /* structural offsets, walked from pos */
+  size_t* idx;
+  size_t nidx;
+  size_t size;
+  size_t pos;
+
+  /* delimiters */
+  uint8_t delims[CSV_MAX_DELIMS];
+  size_t ndelim;
+  uint8_t is_struct[256];
+
+} csv_tok_t;
+
+typedef struct csv_line
+{
+  /* next token offset, comment or newline offset */
+  size_t off;
+  size_t end;
+
+  /* index of the structural ending the next token */
+  size_t pos;
+
+} csv_line_t;
+
+static int tok_init(csv_tok_t* t, const csv_opts_t* opts)
+{
+  const char* delims = CSV_DEFAULT_DELIMS;
+  size_t i;
+
+  if ((opts != NULL) && (opts->delims != NULL)) delims = opts->delims;
+
+  memset(t->is_struct, 0, sizeof(t->is_struct));
+  t->is_struct['\n'] = 1;
+  t->is_struct['#'] = 1;
+
+  t->ndelim = 0;
+  for (i = 0; delims[i]; ++i)
+  {
+    const uint8_t c = (uint8_t)delims[i];
+    if (t->is_struct[c]) continue ;
+    if (t->ndelim == CSV_MAX_DELIMS) return -1;
+    t->delims[t->ndelim++] = c;
+    t->is_struct[c] = 1;
+  }
+
+  t->size = CSV_TOK_CHUNK_SIZE / 4;
+  t->idx = malloc(t->size * sizeof(size_t));
+  if (t->idx == NULL) return -1;
+
+  t->base = NULL;
+  t->len = 0;
+  t->off = 0;
+  t->chunk_off = 0;
+  t->cur = 0;
+  t->nidx = 0;
+  t->pos = 0;
+
   return 0;
 }
 
-int csv_get_col(csv_handle_t* csv, size_t i, double** x, size_t* n)
+static void tok_fini(csv_tok_t* t)
 {
-  /* i the column index. assumed correct. */
-  /* x the value array */
-  /* n the array size */
+  free(t->idx);
+}
 
-  *x = csv->cols + i * csv->nline;
-  *n = csv->nline;
+static void tok_reset(csv_tok_t* t, const uint8_t* base, size_t len)
+{
+  t->base = base;
+  t->len = len;
+  t->off = 0;
+  t->chunk_off = 0;
+  t->cur = 0;
+  t->nidx = 0;
+  t->pos = 0;
+}
+
+static void tok_rewind_chunk(csv_tok_t* t)
+{
+  /* walk the current chunk again */
+  t->cur = t->chunk_off;
+  t->pos = 0;
+}
+
+static inline uint8_t tok_char(const csv_tok_t* t, size_t off)
+{
+  return off == t->len ? '\n' : t->base[off];
+}
+
+static int tok_reserve(csv_tok_t* t, size_t n)
+{
+  size_t* idx;
+
+  if ((t->nidx + n) <= t->size) return 0;
+
+  idx = realloc(t->idx, t->size * 2 * sizeof(size_t));
+  if (idx == NULL) return -1;
+  t->idx = idx;
+  t->size *= 2;
+
+  return 0;
+}
+
+static int scan_scalar(csv_tok_t* t, size_t i, size_t n)
+{
+  for (; i != n; ++i)
+  {
+    if (t->is_struct[t->base[i]] == 0) continue ;
+    if (tok_reserve(t, 1)) return -1;
+    t->idx[t->nidx++] = i;
+  }
+
+  return 0;
+}
+
+#if defined(__AVX2__)
+
+#include <immintrin.h>
+
+static int scan(csv_tok_t* t, size_t i, size_t n)
+{
+  const __m256i nl = _mm256_set1_epi8('\n');
+  const __m256i sharp = _mm256_set1_epi8('#');
+  __m256i delims[CSV_MAX_DELIMS];
+  size_t j;
+
+  for (j = 0; j != t->ndelim; ++j)
+    delims[j] = _mm256_set1_epi8((char)t->delims[j]);
+
+  for (; (i + 32) <= n; i += 32)
+  {
+    const __m256i x = _mm256_loadu_si256((const __m256i*)(t->base + i));
+    __m256i m = _mm256_or_si256
+      (_mm256_cmpeq_epi8(x, nl), _mm256_cmpeq_epi8(x, sharp));
+    uint32_t mask;
+
+    for (j = 0; j != t->ndelim; ++j)
+      m = _mm256_or_si256(m, _mm256_cmpeq_epi8(x, delims[j]));
+
+    mask = (uint32_t)_mm256_movemask_epi8(m);
+    if (mask == 0) continue ;
+
+    if (tok_reserve(t, 32)) return -1;
+    for (; mask; mask &= mask - 1)
+      t->idx[t->nidx++] = i + __builtin_ctz(mask);
+  }
+
+  return scan_scalar(t, i, n);
+}
+
+#elif defined(__SSE2__)
+
+#include <emmintrin.h>
+
+static int scan(csv_tok_t* t, size_t i, size_t n)
+{
+  const __m128i nl = _mm_set1_epi8('\n');
+  const __m128i sharp = _mm_set1_epi8('#');
+  __m128i delims[CSV_MAX_DELIMS];
+  size_t j;
+
+  for (j = 0; j != t->ndelim; ++j)
+    delims[j] = _mm_set1_epi8((char)t->delims[j]);
+
+  for (; (i + 16) <= n; i += 16)
+  {
+    const __m128i x = _mm_loadu_si128((const __m128i*)(t->base + i));
+    __m128i m = _mm_or_si128(_mm_cmpeq_epi8(x, nl), _mm_cmpeq_epi8(x, sharp));
+    uint32_t mask;
+
+    for (j = 0; j != t->ndelim; ++j)
+      m = _mm_or_si128(m, _mm_cmpeq_epi8(x, delims[j]));
+
+    mask = (uint32_t)_mm_movemask_epi8(m);
+    if (mask == 0) continue ;
+
+    if (tok_reserve(t, 16)) return -1;
+    for (; mask; mask &= mask - 1)
+      t->idx[t->nidx++] = i + __builtin_ctz(mask);
+  }
+
+  return scan_scalar(t, i, n);
+}
+
+#else
+
+static int scan(csv_tok_t* t, size_t i, size_t n)
+{
+  return scan_scalar(t, i, n);
+}
+
+#endif /* __AVX2__ */
+
+static int tok_index(csv_tok_t* t)
+{
+  /* index the next chunk. return -1 if no more data. */
+
+  size_t i;
+  size_t j;
+  size_t k;
+  size_t n;
+
+  t->nidx = 0;
+  t->pos = 0;
+  t->chunk_off = t->off;
+  t->cur = t->off;
+
+  if (t->off == t->len) return -1;
+
+  for (i = t->off; 1; i = n)
+  {
+    n = i + CSV_TOK_CHUNK_SIZE;
+    if (n > t->len) n = t->len;
+
+    k = t->nidx;
+    if (scan(t, i, n)) return -1;
+    if (n == t->len) break ;
+
+    /* end the chunk after the last newline, if any */
+    for (j = t->nidx; j != k; --j)
+      if (t->base[t->idx[j - 1]] == '\n') break ;
+
+    if (j != k)
+    {
+      t->nidx = j;
+      n = t->idx[j - 1] + 1;
+      break ;
+    }
+  }
+
+  /* last line not newline terminated */
+  if ((n == t->len) && (t->base[n - 1] != '\n'))
+  {
+    if (tok_reserve(t, 1)) return -1;
+    t->idx[t->nidx++] = n;
+  }
+
+  t->off = n;
+
+  return 0;
+}
+
+static int next_data_line(csv_tok_t* t, csv_line_t* l)
+{
+  /* next line containing data. empty and comment lines skipped. */
+
+  size_t prev;
+  size_t o;
+  uint8_t c;
+  int has_data;
+
+  while (1)
+  {
+    if (t->pos == t->nidx)
+    {
+      if (tok_index(t)) return -1;
+    }
+
+    l->off = t->cur;
+    l->pos = t->pos;
+
+    /* find comment or newline, and any non delimiter before */
+
+    has_data = 0;
+    for (prev = t->cur; 1; ++t->pos, prev = o + 1)
+    {
+      o = t->idx[t->pos];
+      c = tok_char(t, o);
+      if (o != prev) has_data = 1;
+      if ((c == '\n') || (c == '#')) break ;
+    }
+
+    l->end = o;
+
+    /* skip comment up to the newline */
+    while (tok_char(t, t->idx[t->pos]) != '\n') ++t->pos;
+    t->cur = t->idx[t->pos] + 1;
+    ++t->pos;
+
+    if (has_data) return 0;
+  }
+
+  return -1;
+}
+
+static int next_col(csv_tok_t* t, csv_line_t* l, size_t* off)
+{
+  /* next non empty token, off its offset */
+
+  while (l->off < l->end)
+  {
+    const size_t o = t->idx[l->pos];
+    const size_t b = l->off;
+
+    l->off = o + 1;
+    ++l->pos;
+
+    if (o != b)
+    {
+      *off = b;
+      return 0;
+    }
+  }
+
+  return -1;
+}
+
+static size_t get_col_count(csv_tok_t* t, const csv_line_t* l)
+{
+  csv_line_t tmp = *l;
+  size_t col_count;
+  size_t off;
+  for (col_count = 0; next_col(t, &tmp, &off) != -1; ++col_count) ;
+  return col_count;
+}
+
+static int next_value(csv_tok_t* t, csv_line_t* l, double* x)
+{
+  const char* s;
+  char buf[64];
+  size_t off;
+  size_t n;
+
+  if (next_col(t, l, &off)) return -1;
+
+  s = (const char*)t->base + off;
+
+  /* token at the end of data. the next byte may not be mapped. */
+  if (t->idx[l->pos - 1] == t->len)
+  {
+    n = t->len - off;
+    if (n >= sizeof(buf)) n = sizeof(buf) - 1;
+    memcpy(buf, s, n);
+    buf[n] = 0;
+    s = buf;
+  }
+
+  *x = strtod(s, NULL);
+
+  return 0;
+}
+
+
+/* sparse line index. the offset of every CSV_INDEX_STEP data line is
+   recorded while counting lines, and saved along the file as path.idx.
+   later loads reuse it to skip the counting pass, and range loads seek
+   to the covering offset instead of parsing the whole file. the saved
+   index is tied to the file size, modification time and delimiters.
+ */
+
+#define CSV_INDEX_STEP 4096
+#define CSV_INDEX_MAGIC 0x3158444956534355ULL
+
+typedef struct csv_index
+{
+  size_t nline;
+  size_t ncol;
+
+  /* offs[i] the offset of the line i * CSV_INDEX_STEP */
+  uint64_t* offs;
+  size_t noff;
+  size_t size;
+
+} csv_index_t;
+
+typedef struct csv_index_header
+{
+  uint64_t magic;
+  uint64_t step;
+  uint64_t file_size;
+  uint64_t mtime_sec;
+  uint64_t mtime_nsec;
+  uint64_t nline;
+  uint64_t ncol;
+  uint64_t noff;
+  uint8_t delims[CSV_MAX_DELIMS];
+} csv_index_header_t;
+
+static void index_init(csv_index_t* ix)
+{
+  ix->nline = 0;
+  ix->ncol = 0;
+  ix->offs = NULL;
+  ix->noff = 0;
+  ix->size = 0;
+}
+
+static void index_fini(csv_index_t* ix)
+{
+  if (ix->offs != NULL) free(ix->offs);
+}
+
+static int index_push(csv_index_t* ix, uint64_t off)
+{
+  if (ix->noff == ix->size)
+  {
+    const size_t size = ix->size ? ix->size * 2 : 64;
+    uint64_t* const offs = realloc(ix->offs, size * sizeof(uint64_t));
+    if (offs == NULL) return -1;
+    ix->offs = offs;
+    ix->size = size;
+  }
+
+  ix->offs[ix->noff++] = off;
+
+  return 0;
+}
+
+static int index_build(csv_index_t* ix, csv_tok_t* t)
+{
+  /* scan all the lines from the tokenizer start */
+
+  csv_line_t ml;
+
+  ix->nline = 0;
+  ix->ncol = 0;
+  ix->noff = 0;
+
+  for (; next_data_line(t, &ml) == 0; ++ix->nline)
+  {
+    if (ix->nline == 0) ix->ncol = get_col_count(t, &ml);
+    if ((ix->nline % CSV_INDEX_STEP) == 0)
+    {
+      if (index_push(ix, ml.off)) return -1;
+    }
+  }
+
+  return 0;
+}
+
+static void index_make_header
+(csv_index_header_t* h, const mapped_file_t* mf, const csv_tok_t* t)
+{
+  memset(h, 0, sizeof(csv_index_header_t));
+  h->magic = CSV_INDEX_MAGIC;
+  h->step = CSV_INDEX_STEP;
+  h->file_size = (uint64_t)mf->st.st_size;
+  h->mtime_sec = (uint64_t)mf->st.st_mtim.tv_sec;
+  h->mtime_nsec = (uint64_t)mf->st.st_mtim.tv_nsec;
+  memcpy(h->delims, t->delims, t->ndelim);
+}
+
+static int index_load
+(csv_index_t* ix, const char* path, const mapped_file_t* mf, const csv_tok_t* t)
+{
+  char ipath[PATH_MAX];
+  csv_index_header_t ref;
+  csv_index_header_t h;
+  int err = -1;
+  size_t size;
+  int fd;
+
+  if (snprintf(ipath, sizeof(ipath), "%s.idx", path) >= sizeof(ipath))
+    return -1;
+
+  fd = open(ipath, O_RDONLY);
+  if (fd == -1) return -1;
+
+  if (read(fd, &h, sizeof(h)) != sizeof(h)) goto on_error;
+
+  index_make_header(&ref, mf, t);
+  ref.nline = h.nline;
+  ref.ncol = h.ncol;
+  ref.noff = h.noff;
+  if (memcmp(&h, &ref, sizeof(h))) goto on_error;
+
+  /* one offset per started step */
+  if (h.noff != (h.nline + CSV_INDEX_STEP - 1) / CSV_INDEX_STEP)
+    goto on_error;
+
+  size = h.noff * sizeof(uint64_t);
+  ix->offs = realloc(ix->offs, size);
+  if (ix->offs == NULL) goto on_error;
+  ix->size = h.noff;
+
+  if (read(fd, ix->offs, size) != (ssize_t)size) goto on_error;
+
+  ix->nline = h.nline;
+  ix->ncol = h.ncol;
+  ix->noff = h.noff;
+
+  err = 0;
+
+ on_error:
+  close(fd);
+  return err;
+}
+
+static void index_save
+(const csv_index_t* ix, const char* path, const mapped_file_t* mf, const csv_tok_t* t)
+{
+  /* best effort, the directory may not be writable */
+
+  char ipath[PATH_MAX];
+  char tpath[PATH_MAX];
+  csv_index_header_t h;
+  size_t size;
+  int fd;
+
+  /* not worth a file */
+  if (ix->noff < 2) return ;
+
+  if (snprintf(ipath, sizeof(ipath), "%s.idx", path) >= sizeof(ipath))
+    return ;
+  if (snprintf(tpath, sizeof(tpath), "%s.idx.tmp", path) >= sizeof(tpath))
+    return ;
+
+  index_make_header(&h, mf, t);
+  h.nline = ix->nline;
+  h.ncol = ix->ncol;
+  h.noff = ix->noff;
+
+  fd = open(tpath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd == -1) return ;
+
+  size = ix->noff * sizeof(uint64_t);
+  if ((write(fd, &h, sizeof(h)) != sizeof(h)) ||
+      (write(fd, ix->offs, size) != (ssize_t)size))
+  {
+    close(fd);
+    unlink(tpath);
+    return ;
+  }
+
+  close(fd);
+
+  /* atomically replace the previous one */
+  if (rename(tpath, ipath)) unlink(tpath);
+}
+
+static int get_index
+(csv_index_t* ix, const char* path, const mapped_file_t* mf, csv_tok_t* t)
+{
+  /* load the index, or build and save it */
+
+  if (index_load(ix, path, mf, t) == 0) return 0;
+
+  tok_reset(t, mf->base, mf->len);
+  if (index_build(ix, t)) return -1;
+  index_save(ix, path, mf, t);
+
+  return 0;
+}
+
+static int load_lines(csv_handle_t* csv, csv_tok_t* t)
+{
+  /* parse csv->nline lines from the tokenizer current position */
+
+  csv_line_t ml;
+  size_t cpos;
+  size_t lpos;
+
+  csv->cols = malloc(csv->nline * csv->ncol * sizeof(double));
+  if (csv->cols == NULL)
+  {
+    CSV_PERROR();
+    return -1;
+  }
+
+  for (lpos = 0; lpos != csv->nline; ++lpos)
+  {
+    if (next_data_line(t, &ml))
+    {
+      CSV_PERROR();
+      goto on_error;
+    }
+
+    for (cpos = 0; cpos != csv->ncol; ++cpos)
+    {
+      double* const x = csv->cols + cpos * csv->nline + lpos;
+      if (next_value(t, &ml, x))
+      {
+	CSV_PERROR();
+	goto on_error;
+      }
+    }
+  }
+
+  return 0;
+
+ on_error:
+  free(csv->cols);
+  csv->cols = NULL;
+  return -1;
+}
+
+
+/* exported */
+
+int csv_load_file(csv_handle_t* csv, const char* path, const csv_opts_t* opts)
+{
+  /* opts may be NULL for default options */
+
+  mapped_file_t mf;
+  csv_index_t ix;
+  csv_tok_t tok;
+  int err = -1;
+
+  csv->nline = 0;
+  csv->ncol = 0;
+  csv->cols = NULL;
+
+  if (map_file(&mf, path))
+  {
+    CSV_PERROR();
+    goto on_error_0;
+  }
+
+  if (decode_file(&mf))
+  {
+    CSV_PERROR();
+    goto on_error_1;
+  }
+
+  if (tok_init(&tok, opts))
+  {
+    CSV_PERROR();
+    goto on_error_1;
+  }
+
+  index_init(&ix);
+
+  /* get line and column counts */
+
+  if (get_index(&ix, path, &mf, &tok))
+  {
+    CSV_PERROR();
+    goto on_error_2;
+  }
+
+  csv->nline = ix.nline;
+  csv->ncol = ix.ncol;
+  if ((csv->nline == 0) || (csv->ncol == 0))
+  {
+    CSV_PERROR();
+    goto on_error_2;
+  }
+
+  /* get values */
+
+  tok_reset(&tok, mf.base, mf.len);
+  if (load_lines(csv, &tok))
+  {
+    CSV_PERROR();
+    goto on_error_2;
+  }
+
+  /* success */
+
+  err = 0;
+
+ on_error_2:
+  index_fini(&ix);
+  tok_fini(&tok);
+ on_error_1:
+  unmap_file(&mf);
+ on_error_0:
+  return err;
+}
+
+int csv_load_lines
+(
+ csv_handle_t* csv, const char* path, const csv_opts_t* opts,
+ size_t lo, size_t n
+)
+{
+  /* load the n data lines starting at line lo */
+  /* opts may be NULL for default options */
+
+  mapped_file_t mf;
+  csv_index_t ix;
+  csv_tok_t tok;
+  csv_line_t ml;
+  int err = -1;
+  size_t off;
+  size_t i;
+
+  csv->nline = 0;
+  csv->ncol = 0;
+  csv->cols = NULL;
+
+  if (map_file(&mf, path))
+  {
+    CSV_PERROR();
+    goto on_error_0;
+  }
+
+  if (decode_file(&mf))
+  {
+    CSV_PERROR();
+    goto on_error_1;
+  }
+
+  if (tok_init(&tok, opts))
+  {
+    CSV_PERROR();
+    goto on_error_1;
+  }
+
+  index_init(&ix);
+
+  if (get_index(&ix, path, &mf, &tok))
+  {
+    CSV_PERROR();
+    goto on_error_2;
+  }
+
+  if ((n == 0) || (ix.ncol == 0) || ((lo + n) > ix.nline))
+  {
+    CSV_PERROR();
+    goto on_error_2;
+  }
+
+  /* seek to the covering line, skip up to lo */
+
+  off = (size_t)ix.offs[lo / CSV_INDEX_STEP];
+  tok_reset(&tok, mf.base + off, mf.len - off);
+
+  for (i = 0; i != (lo % CSV_INDEX_STEP); ++i)
+  {
+    if (next_data_line(&tok, &ml))
+    {
+      CSV_PERROR();
+      goto on_error_2;
+    }
+  }
+
+  csv->nline = n;
+  csv->ncol = ix.ncol;
+  if (load_lines(csv, &tok))
+  {
+    CSV_PERROR();
+    goto on_error_2;
+  }
+
+  err = 0;
+
+ on_error_2:
+  index_fini(&ix);
+  tok_fini(&tok);
+ on_error_1:
+  unmap_file(&mf);
+ on_error_0:
+  return err;
+}
+
+int csv_close(csv_handle_t* csv)
+{
+  /* may be null if no lines */
+  if (csv->cols != NULL) free(csv->cols);
+  return 0;
+}
+
+int csv_get_col(csv_handle_t* csv, size_t i, double** x, size_t* n)
+{
+  /* i the column index. assumed correct. */
+  /* x the value array */
+  /* n the array size */
+
+  *x = csv->cols + i * csv->nline;
+  *n = csv->nline;
+
+  return 0;
+}
+
+
+/* streaming reader. data are read () into a bounded buffer, so that
+   pipes and stdin work too and memory does not depend on the file size.
+   compressed data are decoded on the fly.
+   only complete lines are parsed, the remaining bytes are moved to the
+   buffer start before the next refill.
+ */
+
+#define CSV_STREAM_BUF_SIZE (1 << 20)
+
+static int stream_fill(csv_stream_t* cs)
+{
+  /* move the unparsed bytes at the buffer start and read more */
+
+  ssize_t n;
+
+  if (cs->off)
+  {
+    memmove(cs->buf, cs->buf + cs->off, cs->len - cs->off);
+    cs->len -= cs->off;
+    cs->off = 0;
+  }
+
+  if (cs->len == cs->size)
+  {
+    /* a line does not fit, grow the buffer */
+    uint8_t* const buf = realloc(cs->buf, cs->size * 2 + 1);
+    if (buf == NULL) return -1;
+    cs->buf = buf;
+    cs->size *= 2;
+  }
+
+  /* a single read, not to wait for a full buffer on pipes. callers
+     refill until a complete line is available. */
+  n = dec_read(cs->dec, cs->buf + cs->len, cs->size - cs->len);
+  if (n < 0) return -1;
+  if (n == 0) cs->is_eof = 1;
+  cs->len += (size_t)n;
+
+  /* strtod stops there */
+  cs->buf[cs->len] = 0;
+
+  return 0;
+}
+
+static size_t stream_avail(csv_stream_t* cs)
+{
+  /* return the end of the last complete line in buffer */
+
+  const uint8_t* p;
+
+  if (cs->is_eof) return cs->len;
+
+  for (p = cs->buf + cs->len; p != cs->buf + cs->off; --p)
+  {
+    if (p[-1] == '\n') break ;
+  }
+
+  return p - cs->buf;
+}
+
+static int stream_next_data_line(csv_stream_t* cs, csv_line_t* l)
+{
+  /* the tokenizer works on [0, off[, refill when consumed */
+
+  while (next_data_line(cs->tok, l))
+  {
+    if (cs->is_eof) return -1;
+    if (stream_fill(cs)) return -1;
+    cs->off = stream_avail(cs);
+    tok_reset(cs->tok, cs->buf, cs->off);
+  }
+
+  return 0;
+}
+
+int csv_stream_open(csv_stream_t* cs, const char* path, const csv_opts_t* opts)
+{
+  /* path is NULL or "-" for stdin */
+  /* opts may be NULL for default options */
+
+  csv_line_t ml;
+
+  cs->fd = 0;
+  if ((path != NULL) && strcmp(path, "-"))
+  {
+    cs->fd = open(path, O_RDONLY);
+    if (cs->fd == -1)
+    {
+      CSV_PERROR();
+      goto on_error_0;
+    }
+  }
+
+  cs->dec = malloc(sizeof(csv_dec_t));
+  if (cs->dec == NULL)
+  {
+    CSV_PERROR();
+    goto on_error_1;
+  }
+
+  if (dec_open_fd(cs->dec, cs->fd))
+  {
+    CSV_PERROR();
+    goto on_error_2;
+  }
+
+  cs->tok = malloc(sizeof(csv_tok_t));
+  if (cs->tok == NULL)
+  {
+    CSV_PERROR();
+    goto on_error_3;
+  }
+
+  if (tok_init(cs->tok, opts))
+  {
+    CSV_PERROR();
+    goto on_error_4;
+  }
+
+  cs->size = CSV_STREAM_BUF_SIZE;
+  cs->buf = malloc(cs->size + 1);
+  if (cs->buf == NULL)
+  {
+    CSV_PERROR();
+    goto on_error_5;
+  }
+
+  cs->off = 0;
+  cs->len = 0;
+  cs->is_eof = 0;
+  cs->ncol = 0;
+
+  if (stream_fill(cs))
+  {
+    CSV_PERROR();
+    goto on_error_6;
+  }
+
+  cs->off = stream_avail(cs);
+  tok_reset(cs->tok, cs->buf, cs->off);
+
+  /* get column count, keep the line for the first read */
+
+  if (stream_next_data_line(cs, &ml))
+  {
+    CSV_PERROR();
+    goto on_error_6;
+  }
+
+  cs->ncol = get_col_count(cs->tok, &ml);
+  if (cs->ncol == 0)
+  {
+    CSV_PERROR();
+    goto on_error_6;
+  }
+
+  tok_rewind_chunk(cs->tok);
+
+  return 0;
+
+ on_error_6:
+  free(cs->buf);
+ on_error_5:
+  tok_fini(cs->tok);
+ on_error_4:
+  free(cs->tok);
+ on_error_3:
+  dec_close(cs->dec);
+ on_error_2:
+  free(cs->dec);
+ on_error_1:
+  if (cs->fd) close(cs->fd);
+ on_error_0:
+  return -1;
+}
+
+int csv_stream_read(csv_stream_t* cs, double* cols, size_t n, size_t* nline)
+{
+  /* cols the column major output, n lines per column */
+  /* nline the actual line count, 0 at end of stream */
+
+  csv_line_t ml;
+  size_t lpos;
+  size_t cpos;
+
+  for (lpos = 0; lpos != n; ++lpos)
+  {
+    if (stream_next_data_line(cs, &ml)) break ;
+
+    for (cpos = 0; cpos != cs->ncol; ++cpos)
+    {
+      if (next_value(cs->tok, &ml, cols + cpos * n + lpos))
+      {
+	CSV_PERROR();
+	return -1;
+      }
+    }
+  }
+
+  *nline = lpos;
+
+  return 0;
+}
+
+int csv_stream_close(csv_stream_t* cs)
+{
+  free(cs->buf);
+  tok_fini(cs->tok);
+  free(cs->tok);
+  dec_close(cs->dec);
+  free(cs->dec);
+  if (cs->fd) close(cs->fd);
+  return 0;
+}
+
+
+/* buffered writer. values are formatted in a large buffer and written
+   in one system call when it fills up. text values use the shortest
+   representation that reads back to the same double. binary values are
+   native doubles without separator, one line being ncol doubles.
+ */
+
+#define CSV_WRITER_BUF_SIZE (1 << 20)
+
+int csv_writer_open(csv_writer_t* w, const char* path, int format)
+{
+  /* path is NULL or "-" for stdout */
+
+  w->fd = 1;
+  if ((path != NULL) && strcmp(path, "-"))
+  {
+    w->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (w->fd == -1)
+    {
+      CSV_PERROR();
+      goto on_error_0;
+    }
+  }
+
+  w->size = CSV_WRITER_BUF_SIZE;
+  w->buf = malloc(w->size);
+  if (w->buf == NULL)
+  {
+    CSV_PERROR();
+    goto on_error_1;
+  }
+
+  w->format = format;
+  w->len = 0;
+  w->col = 0;
+  w->is_error = 0;
+
+  if (format == CSV_WRITER_TEXT) dtoa_init();
+
+  return 0;
+
+ on_error_1:
+  if (w->fd != 1) close(w->fd);
+ on_error_0:
+  return -1;
+}
+
+int csv_writer_flush(csv_writer_t* w)
+{
+  size_t off;
+  ssize_t n;
+
+  for (off = 0; off != w->len; off += (size_t)n)
+  {
+    n = write(w->fd, w->buf + off, w->len - off);
+    if (n <= 0)
+    {
+      CSV_PERROR();
+      w->is_error = 1;
+      break ;
+    }
+  }
+
+  w->len = 0;
+
+  return w->is_error ? -1 : 0;
+}
+
+int csv_writer_put(csv_writer_t* w, double x)
+{
+  /* room for a separator and the longest value */
+  if ((w->size - w->len) < (1 + DTOA_MAX_LEN))
+  {
+    if (csv_writer_flush(w)) return -1;
+  }
+
+  if (w->format == CSV_WRITER_BINARY)
+  {
+    memcpy(w->buf + w->len, &x, sizeof(double));
+    w->len += sizeof(double);
+  }
+  else
+  {
+    if (w->col) w->buf[w->len++] = ' ';
+    w->len += dtoa_shortest((char*)w->buf + w->len, x);
+  }
+
+  ++w->col;
+
+  return 0;
+}
+
+int csv_writer_endl(csv_writer_t* w)
+{
+  if (w->format == CSV_WRITER_TEXT)
+  {
+    if (w->len == w->size)
+    {
+      if (csv_writer_flush(w)) return -1;
+    }
+
+    w->buf[w->len++] = '\n';
+  }
+
+  w->col = 0;
 
   return 0;
 }
 
+int csv_writer_close(csv_writer_t* w)
+{
+  /* return -1 if any write failed */
+
+  csv_writer_flush(w);
+  free(w->buf);
+  if ((w->fd != 1) && close(w->fd)) w->is_error = 1;
+  return w->is_error ? -1 : 0;
+}
+
 
 #if CSV_CONFIG_UNIT /* unit */
 
@@ -245,7 +1836,7 @@ int main(int ac, char** av)
   size_t n;
   size_t i;
 
-  csv_load_file(&csv, filename);
+  csv_load_file(&csv, filename, NULL);
 
   printf("nline == %zu, ncol == %zu\n", csv.nline, csv.ncol);
 
@@ -5,6 +5,15 @@
 #include <sys/types.h>
 
 
+#define CSV_MAX_DELIMS 8
+
+typedef struct csv_opts
+{
+  /* field delimiters, at most CSV_MAX_DELIMS. NULL for default. */
+  const char* delims;
+
+} csv_opts_t;
+
 typedef struct csv_handle
 {
   size_t nline;
@@ -12,10 +21,63 @@ typedef struct csv_handle
   double* cols;
 } csv_handle_t;
 
+typedef struct csv_stream
+{
+  int fd;
+  size_t ncol;
+
+  /* read buffer. [0, off[ tokenized, [off, len[ pending. */
+  unsigned char* buf;
+  size_t size;
+  size_t off;
+  size_t len;
+  int is_eof;
+
+  /* decoder, structural index */
+  struct csv_dec* dec;
+  struct csv_tok* tok;
+
+} csv_stream_t;
+
+#define CSV_WRITER_TEXT 0
+#define CSV_WRITER_BINARY 1
 
-int csv_load_file(csv_handle_t*, const char*);
+typedef struct csv_writer
+{
+  int fd;
+
+  /* CSV_WRITER_xxx */
+  int format;
+
+  /* write buffer, flushed when full */
+  unsigned char* buf;
+  size_t size;
+  size_t len;
+
+  /* values in the current line */
+  size_t col;
+
+  /* sticky, reported by close */
+  int is_error;
+
+} csv_writer_t;
+
+
+int csv_load_file(csv_handle_t*, const char*, const csv_opts_t*);
+int csv_load_lines
+(csv_handle_t*, const char*, const csv_opts_t*, size_t, size_t);
 int csv_close(csv_handle_t*);
 int csv_get_col(csv_handle_t*, size_t, double**, size_t*);
 
+int csv_stream_open(csv_stream_t*, const char*, const csv_opts_t*);
+int csv_stream_read(csv_stream_t*, double*, size_t, size_t*);
+int csv_stream_close(csv_stream_t*);
+
+int csv_writer_open(csv_writer_t*, const char*, int);
+int csv_writer_put(csv_writer_t*, double);
+int csv_writer_endl(csv_writer_t*);
+int csv_writer_flush(csv_writer_t*);
+int csv_writer_close(csv_writer_t*);
+
 
 #endif /* CSV_H_INCLUDED */
@@ -0,0 +1,215 @@
+#include <stdlib.h>
+#include <math.h>
+#include <sys/types.h>
+#include <fftw3.h>
+#include "czt.h"
+
+
+/* chirp z transform, using bluestein algorithm. it computes:
+   y[k] = sum(x[j] * exp(-i * (w0 + k * dw) * j)), j < n, k < m
+   as a convolution of length nfft >= n + m - 1, where nfft has only
+   small prime factors. w0 = 0 and dw = 2 * pi / n give the dft of
+   any length, in O(nfft * log(nfft)).
+   with jk = (j^2 + k^2 - (k - j)^2) / 2, we have:
+   y[k] = b[k] * sum((x[j] * a[j]) * conj(b[k - j]))
+   a[j] = exp(-i * (w0 * j + dw * j^2 / 2)), b[k] = exp(-i * dw * k^2 / 2)
+ */
+
+static void set_phase(fftw_complex z, long double phi)
+{
+  /* the phase grows as j^2, reduce it before sin and cos */
+
+  phi = fmodl(phi, 2.0L * (long double)M_PI);
+  z[0] = (double)cosl(phi);
+  z[1] = (double)sinl(phi);
+}
+
+static int is_small_factor(size_t n)
+{
+  /* only 2, 3, 5, 7 factors */
+
+  static const size_t f[] = { 2, 3, 5, 7 };
+  size_t i;
+
+  if (n == 0) return 0;
+
+  for (i = 0; i != sizeof(f) / sizeof(f[0]); ++i)
+  {
+    while ((n % f[i]) == 0) n /= f[i];
+  }
+
+  return n == 1;
+}
+
+size_t czt_next_size(size_t n)
+{
+  /* smallest 2^a 3^b 5^c 7^d >= n */
+
+  if (n == 0) return 1;
+  for (; is_small_factor(n) == 0; ++n) ;
+  return n;
+}
+
+size_t czt_prev_size(size_t n)
+{
+  /* largest 2^a 3^b 5^c 7^d <= n */
+
+  if (n == 0) return 0;
+  for (; is_small_factor(n) == 0; --n) ;
+  return n;
+}
+
+size_t czt_max_factor(size_t n)
+{
+  size_t f;
+  size_t m = 1;
+
+  for (f = 2; (f * f) <= n; ++f)
+  {
+    for (; (n % f) == 0; n /= f) m = f;
+  }
+
+  if (n > m) m = n;
+
+  return m;
+}
+
+int czt_init(czt_t* czt, size_t n, size_t m, double w0, double dw)
+{
+  /* n the input length, m the output length */
+  /* w0 the first angular frequency, dw the step, in radians per sample */
+
+  const long double ldw = (long double)dw;
+  const long double lw0 = (long double)w0;
+  long double j2;
+  size_t j;
+
+  czt->n = n;
+  czt->m = m;
+  czt->nfft = czt_next_size(n + m - 1);
+
+  czt->a = fftw_malloc(n * sizeof(fftw_complex));
+  if (czt->a == NULL) goto on_error_0;
+
+  czt->b = fftw_malloc(m * sizeof(fftw_complex));
+  if (czt->b == NULL) goto on_error_1;
+
+  czt->h = fftw_malloc(czt->nfft * sizeof(fftw_complex));
+  if (czt->h == NULL) goto on_error_2;
+
+  czt->buf = fftw_malloc(czt->nfft * sizeof(fftw_complex));
+  if (czt->buf == NULL) goto on_error_3;
+
+  czt->fwd = fftw_plan_dft_1d
+    ((int)czt->nfft, czt->buf, czt->buf, FFTW_FORWARD, FFTW_ESTIMATE);
+  if (czt->fwd == NULL) goto on_error_4;
+
+  czt->bwd = fftw_plan_dft_1d
+    ((int)czt->nfft, czt->buf, czt->buf, FFTW_BACKWARD, FFTW_ESTIMATE);
+  if (czt->bwd == NULL) goto on_error_5;
+
+  for (j = 0; j != n; ++j)
+  {
+    j2 = (long double)j * (long double)j;
+    set_phase(czt->a[j], -(lw0 * (long double)j + ldw * j2 / 2.0L));
+  }
+
+  for (j = 0; j != m; ++j)
+  {
+    j2 = (long double)j * (long double)j;
+    set_phase(czt->b[j], -ldw * j2 / 2.0L);
+  }
+
+  /* conj(b[l]) for l in ]-n, m[, circularly, pre scaled by 1 / nfft */
+
+  for (j = 0; j != czt->nfft; ++j)
+  {
+    czt->buf[j][0] = 0;
+    czt->buf[j][1] = 0;
+  }
+
+  for (j = 0; j != m; ++j)
+  {
+    j2 = (long double)j * (long double)j;
+    set_phase(czt->buf[j], ldw * j2 / 2.0L);
+  }
+
+  for (j = 1; j != n; ++j)
+  {
+    j2 = (long double)j * (long double)j;
+    set_phase(czt->buf[czt->nfft - j], ldw * j2 / 2.0L);
+  }
+
+  fftw_execute(czt->fwd);
+
+  for (j = 0; j != czt->nfft; ++j)
+  {
+    czt->h[j][0] = czt->buf[j][0] / (double)czt->nfft;
+    czt->h[j][1] = czt->buf[j][1] / (double)czt->nfft;
+  }
+
+  return 0;
+
+ on_error_5:
+  fftw_destroy_plan(czt->fwd);
+ on_error_4:
+  fftw_free(czt->buf);
+ on_error_3:
+  fftw_free(czt->h);
+ on_error_2:
+  fftw_free(czt->b);
+ on_error_1:
+  fftw_free(czt->a);
+ on_error_0:
+  return -1;
+}
+
+void czt_fini(czt_t* czt)
+{
+  fftw_destroy_plan(czt->bwd);
+  fftw_destroy_plan(czt->fwd);
+  fftw_free(czt->buf);
+  fftw_free(czt->h);
+  fftw_free(czt->b);
+  fftw_free(czt->a);
+}
+
+void czt_exec(czt_t* czt, const fftw_complex* x, fftw_complex* y)
+{
+  /* x the n inputs, y the m outputs */
+
+  fftw_complex* const buf = czt->buf;
+  double re;
+  double im;
+  size_t j;
+
+  for (j = 0; j != czt->n; ++j)
+  {
+    buf[j][0] = x[j][0] * czt->a[j][0] - x[j][1] * czt->a[j][1];
+    buf[j][1] = x[j][0] * czt->a[j][1] + x[j][1] * czt->a[j][0];
+  }
+
+  for (; j != czt->nfft; ++j)
+  {
+    buf[j][0] = 0;
+    buf[j][1] = 0;
+  }
+
+  fftw_execute(czt->fwd);
+
+  for (j = 0; j != czt->nfft; ++j)
+  {
+    re = buf[j][0] * czt->h[j][0] - buf[j][1] * czt->h[j][1];
+    im = buf[j][0] * czt->h[j][1] + buf[j][1] * czt->h[j][0];
+    buf[j][0] = re;
+    buf[j][1] = im;
+  }
+
+  fftw_execute(czt->bwd);
+
+  for (j = 0; j != czt->m; ++j)
+  {
+    y[j][0] = buf[j][0] * czt->b[j][0] - buf[j][1] * czt->b[j][1];
+    y[j][1] = buf[j][0] * czt->b[j][1] + buf[j][1] * czt->b[j][0];
+  }
+}
@@ -0,0 +1,41 @@
+#ifndef CZT_H_INCLUDED
+#define CZT_H_INCLUDED
+
+
+#include <sys/types.h>
+#include <fftw3.h>
+
+
+/* lengths with a larger prime factor are much slower with fftw */
+#define CZT_SLOW_FACTOR 64
+
+typedef struct czt
+{
+  /* input and output lengths, convolution length */
+  size_t n;
+  size_t m;
+  size_t nfft;
+
+  /* input and output chirps, transformed convolution chirp */
+  fftw_complex* a;
+  fftw_complex* b;
+  fftw_complex* h;
+
+  /* convolution buffer, transformed in place */
+  fftw_complex* buf;
+  fftw_plan fwd;
+  fftw_plan bwd;
+
+} czt_t;
+
+
+int czt_init(czt_t*, size_t, size_t, double, double);
+void czt_fini(czt_t*);
+void czt_exec(czt_t*, const fftw_complex*, fftw_complex*);
+
+size_t czt_next_size(size_t);
+size_t czt_prev_size(size_t);
+size_t czt_max_factor(size_t);
+
+
+#endif /* CZT_H_INCLUDED */
@@ -0,0 +1,552 @@
+#include <stdint.h>
+#include <string.h>
+#include "dtoa.h"
+
+
+/* shortest round trip double formatting, after ryu (ulf adams, 2018).
+   the shortest decimal in the rounding interval of a double is found
+   using 128 bits approximations of 5^i and 5^-i, instead of the
+   repeated printf and strtod a %.17g loop would need. the tables are
+   computed once by dtoa_init, using a small bignum, rather than being
+   pasted here.
+ */
+
+#define DOUBLE_MANTISSA_BITS 52
+#define DOUBLE_EXPONENT_BITS 11
+#define DOUBLE_BIAS 1023
+
+#define DOUBLE_POW5_INV_BITCOUNT 125
+#define DOUBLE_POW5_BITCOUNT 125
+
+#define DOUBLE_POW5_INV_TABLE_SIZE 342
+#define DOUBLE_POW5_TABLE_SIZE 326
+
+static uint64_t pow5_inv_split[DOUBLE_POW5_INV_TABLE_SIZE][2];
+static uint64_t pow5_split[DOUBLE_POW5_TABLE_SIZE][2];
+static int is_init = 0;
+
+
+/* bignum, little endian 32 bits limbs */
+
+#define BIGNUM_NLIMB 40
+
+typedef struct bignum
+{
+  uint32_t limbs[BIGNUM_NLIMB];
+} bignum_t;
+
+static void bignum_set(bignum_t* a, uint32_t x)
+{
+  memset(a->limbs, 0, sizeof(a->limbs));
+  a->limbs[0] = x;
+}
+
+static void bignum_mul(bignum_t* a, uint32_t x)
+{
+  uint64_t carry = 0;
+  size_t i;
+
+  for (i = 0; i != BIGNUM_NLIMB; ++i)
+  {
+    carry += (uint64_t)a->limbs[i] * x;
+    a->limbs[i] = (uint32_t)carry;
+    carry >>= 32;
+  }
+}
+
+static void bignum_shl1(bignum_t* a)
+{
+  size_t i;
+
+  for (i = BIGNUM_NLIMB - 1; i != 0; --i)
+    a->limbs[i] = (a->limbs[i] << 1) | (a->limbs[i - 1] >> 31);
+  a->limbs[0] <<= 1;
+}
+
+static int bignum_cmp(const bignum_t* a, const bignum_t* b)
+{
+  size_t i;
+
+  for (i = BIGNUM_NLIMB; i != 0; --i)
+  {
+    if (a->limbs[i - 1] != b->limbs[i - 1])
+      return a->limbs[i - 1] < b->limbs[i - 1] ? -1 : 1;
+  }
+
+  return 0;
+}
+
+static void bignum_sub(bignum_t* a, const bignum_t* b)
+{
+  /* a >= b */
+
+  uint64_t borrow = 0;
+  size_t i;
+
+  for (i = 0; i != BIGNUM_NLIMB; ++i)
+  {
+    const uint64_t x = (uint64_t)a->limbs[i] - b->limbs[i] - borrow;
+    a->limbs[i] = (uint32_t)x;
+    borrow = (x >> 32) & 1;
+  }
+}
+
+static uint32_t bignum_bits(const bignum_t* a)
+{
+  size_t i;
+
+  for (i = BIGNUM_NLIMB; i != 0; --i)
+  {
+    if (a->limbs[i - 1])
+      return (uint32_t)((i - 1) * 32 + 32 - __builtin_clz(a->limbs[i - 1]));
+  }
+
+  return 0;
+}
+
+static unsigned __int128 bignum_bits_at(const bignum_t* a, int32_t lo)
+{
+  /* the 128 bits starting at bit lo, lo may be negative */
+
+  unsigned __int128 x = 0;
+  int32_t i;
+
+  for (i = 127; i >= 0; --i)
+  {
+    const int32_t k = lo + i;
+    x <<= 1;
+    if ((k >= 0) && (k < BIGNUM_NLIMB * 32))
+      x |= (a->limbs[k / 32] >> (k % 32)) & 1;
+  }
+
+  return x;
+}
+
+
+/* integer log approximations, valid on the table ranges */
+
+static inline int32_t pow5bits(int32_t e)
+{
+  /* ceil(log2(5^e)), 1 for e == 0 */
+  return (int32_t)(((uint32_t)e * 1217359) >> 19) + 1;
+}
+
+static inline uint32_t log10_pow2(int32_t e)
+{
+  return ((uint32_t)e * 78913) >> 18;
+}
+
+static inline uint32_t log10_pow5(int32_t e)
+{
+  return ((uint32_t)e * 732923) >> 20;
+}
+
+
+void dtoa_init(void)
+{
+  /* pow5_split[i] = 5^i >> (bits(5^i) - 125) */
+  /* pow5_inv_split[i] = 2^(bits(5^i) - 1 + 125) / 5^i + 1 */
+
+  unsigned __int128 x;
+  bignum_t p;
+  bignum_t r;
+  uint32_t i;
+  uint32_t j;
+  int32_t bits;
+
+  if (is_init) return ;
+
+  bignum_set(&p, 1);
+
+  for (i = 0; i != DOUBLE_POW5_INV_TABLE_SIZE; ++i)
+  {
+    bits = (int32_t)bignum_bits(&p);
+
+    if (i < DOUBLE_POW5_TABLE_SIZE)
+    {
+      x = bignum_bits_at(&p, bits - DOUBLE_POW5_BITCOUNT);
+      pow5_split[i][0] = (uint64_t)x;
+      pow5_split[i][1] = (uint64_t)(x >> 64);
+    }
+
+    /* long division of 2^(bits - 1 + 125) by p */
+
+    bignum_set(&r, 1);
+    for (j = 1; j != (uint32_t)bits; ++j) bignum_shl1(&r);
+
+    x = 0;
+    for (j = 0; j != DOUBLE_POW5_INV_BITCOUNT + 1; ++j)
+    {
+      if (j) bignum_shl1(&r);
+      x <<= 1;
+      if (bignum_cmp(&r, &p) >= 0)
+      {
+	bignum_sub(&r, &p);
+	x |= 1;
+      }
+    }
+
+    x += 1;
+    pow5_inv_split[i][0] = (uint64_t)x;
+    pow5_inv_split[i][1] = (uint64_t)(x >> 64);
+
+    bignum_mul(&p, 5);
+  }
+
+  is_init = 1;
+}
+
+
+/* ryu core */
+
+static inline uint32_t pow5_factor(uint64_t x)
+{
+  uint32_t n = 0;
+  for (; (x % 5) == 0; x /= 5) ++n;
+  return n;
+}
+
+static inline int is_multiple_of_pow5(uint64_t x, uint32_t p)
+{
+  return pow5_factor(x) >= p;
+}
+
+static inline int is_multiple_of_pow2(uint64_t x, uint32_t p)
+{
+  return (x & ((1ULL << p) - 1)) == 0;
+}
+
+static inline uint64_t mul_shift64(uint64_t m, const uint64_t* mul, int32_t j)
+{
+  const unsigned __int128 b0 = (unsigned __int128)m * mul[0];
+  const unsigned __int128 b2 = (unsigned __int128)m * mul[1];
+  return (uint64_t)(((b0 >> 64) + b2) >> (j - 64));
+}
+
+static inline uint32_t decimal_length(uint64_t v)
+{
+  uint32_t n = 1;
+  for (; v >= 10; v /= 10) ++n;
+  return n;
+}
+
+static void d2d
+(uint64_t ieee_mantissa, uint32_t ieee_exponent, uint64_t* digits, int32_t* exp)
+{
+  /* digits * 10^exp the shortest decimal in the rounding interval */
+
+  int32_t e2;
+  uint64_t m2;
+  uint64_t mv;
+  uint64_t vr;
+  uint64_t vp;
+  uint64_t vm;
+  int32_t e10;
+  uint32_t mm_shift;
+  uint32_t q;
+  int32_t k;
+  int32_t i;
+  int is_even;
+  int vm_is_trailing_zeros = 0;
+  int vr_is_trailing_zeros = 0;
+  int32_t removed = 0;
+  uint8_t last_removed_digit = 0;
+  uint64_t output;
+
+  if (ieee_exponent == 0)
+  {
+    e2 = 1 - DOUBLE_BIAS - DOUBLE_MANTISSA_BITS - 2;
+    m2 = ieee_mantissa;
+  }
+  else
+  {
+    e2 = (int32_t)ieee_exponent - DOUBLE_BIAS - DOUBLE_MANTISSA_BITS - 2;
+    m2 = (1ULL << DOUBLE_MANTISSA_BITS) | ieee_mantissa;
+  }
+
+  is_even = (m2 & 1) == 0;
+
+  /* interval bounds are 4 * m2 +/- 2, the lower one closer at powers of 2 */
+  mv = 4 * m2;
+  mm_shift = (ieee_mantissa != 0) || (ieee_exponent <= 1);
+
+  if (e2 >= 0)
+  {
+    q = log10_pow2(e2) - (e2 > 3);
+    e10 = (int32_t)q;
+    k = DOUBLE_POW5_INV_BITCOUNT + pow5bits((int32_t)q) - 1;
+    i = -e2 + (int32_t)q + k;
+
+    vr = mul_shift64(4 * m2, pow5_inv_split[q], i);
+    vp = mul_shift64(4 * m2 + 2, pow5_inv_split[q], i);
+    vm = mul_shift64(4 * m2 - 1 - mm_shift, pow5_inv_split[q], i);
+
+    if (q <= 21)
+    {
+      /* only one of mp, mv and mm can be a multiple of 5 */
+      if ((mv % 5) == 0)
+	vr_is_trailing_zeros = is_multiple_of_pow5(mv, q);
+      else if (is_even)
+	vm_is_trailing_zeros = is_multiple_of_pow5(mv - 1 - mm_shift, q);
+      else
+	vp -= is_multiple_of_pow5(mv + 2, q);
+    }
+  }
+  else
+  {
+    q = log10_pow5(-e2) - (-e2 > 1);
+    e10 = (int32_t)q + e2;
+    i = -e2 - (int32_t)q;
+    k = pow5bits(i) - DOUBLE_POW5_BITCOUNT;
+
+    vr = mul_shift64(4 * m2, pow5_split[i], (int32_t)q - k);
+    vp = mul_shift64(4 * m2 + 2, pow5_split[i], (int32_t)q - k);
+    vm = mul_shift64(4 * m2 - 1 - mm_shift, pow5_split[i], (int32_t)q - k);
+
+    if (q <= 1)
+    {
+      /* mv = 4 * m2 has at least 2 trailing zero bits */
+      vr_is_trailing_zeros = 1;
+      if (is_even) vm_is_trailing_zeros = mm_shift == 1;
+      else --vp;
+    }
+    else if (q < 63)
+    {
+      vr_is_trailing_zeros = is_multiple_of_pow2(mv, q);
+    }
+  }
+
+  /* remove digits while the interval still contains a shorter decimal */
+
+  if (vm_is_trailing_zeros || vr_is_trailing_zeros)
+  {
+    /* general case, rare */
+
+    while ((vp / 10) > (vm / 10))
+    {
+      vm_is_trailing_zeros &= (vm % 10) == 0;
+      vr_is_trailing_zeros &= last_removed_digit == 0;
+      last_removed_digit = (uint8_t)(vr % 10);
+      vr /= 10;
+      vp /= 10;
+      vm /= 10;
+      ++removed;
+    }
+
+    if (vm_is_trailing_zeros)
+    {
+      while ((vm % 10) == 0)
+      {
+	vr_is_trailing_zeros &= last_removed_digit == 0;
+	last_removed_digit = (uint8_t)(vr % 10);
+	vr /= 10;
+	vp /= 10;
+	vm /= 10;
+	++removed;
+      }
+    }
+
+    /* exactly half way, round to even */
+    if (vr_is_trailing_zeros && (last_removed_digit == 5) && ((vr % 2) == 0))
+      last_removed_digit = 4;
+
+    output = vr +
+      (((vr == vm) && (!is_even || !vm_is_trailing_zeros)) ||
+       (last_removed_digit >= 5));
+  }
+  else
+  {
+    /* common case */
+
+    int round_up = 0;
+
+    if ((vp / 100) > (vm / 100))
+    {
+      round_up = (vr % 100) >= 50;
+      vr /= 100;
+      vp /= 100;
+      vm /= 100;
+      removed += 2;
+    }
+
+    while ((vp / 10) > (vm / 10))
+    {
+      round_up = (vr % 10) >= 5;
+      vr /= 10;
+      vp /= 10;
+      vm /= 10;
+      ++removed;
+    }
+
+    output = vr + ((vr == vm) || round_up);
+  }
+
+  *digits = output;
+  *exp = e10 + removed;
+}
+
+
+/* exported */
+
+size_t dtoa_shortest(char* buf, double x)
+{
+  /* format x in buf, at most DTOA_MAX_LEN bytes. return the length. */
+  /* fixed notation for decimal exponents in [-5, 16[, else scientific */
+
+  char digits[20];
+  uint64_t bits;
+  uint64_t ieee_mantissa;
+  uint32_t ieee_exponent;
+  uint64_t output;
+  int32_t exp;
+  int32_t sci;
+  uint32_t ndigit;
+  uint32_t i;
+  size_t n = 0;
+
+  memcpy(&bits, &x, sizeof(double));
+  ieee_mantissa = bits & ((1ULL << DOUBLE_MANTISSA_BITS) - 1);
+  ieee_exponent = (uint32_t)
+    ((bits >> DOUBLE_MANTISSA_BITS) & ((1U << DOUBLE_EXPONENT_BITS) - 1));
+
+  if (ieee_exponent == ((1U << DOUBLE_EXPONENT_BITS) - 1))
+  {
+    if (ieee_mantissa)
+    {
+      memcpy(buf, "nan", 4);
+      return 3;
+    }
+
+    if (bits >> 63) buf[n++] = '-';
+    memcpy(buf + n, "inf", 4);
+    return n + 3;
+  }
+
+  if (bits >> 63) buf[n++] = '-';
+
+  if ((ieee_exponent == 0) && (ieee_mantissa == 0))
+  {
+    buf[n++] = '0';
+    buf[n] = 0;
+    return n;
+  }
+
+  d2d(ieee_mantissa, ieee_exponent, &output, &exp);
+
+  ndigit = decimal_length(output);
+  i = ndigit;
+  do
+  {
+    digits[--i] = (char)('0' + output % 10);
+    output /= 10;
+  } while (i);
+
+  /* exponent of the leading digit */
+  sci = exp + (int32_t)ndigit - 1;
+
+  if ((sci < -5) || (sci >= 16))
+  {
+    buf[n++] = digits[0];
+    if (ndigit > 1)
+    {
+      buf[n++] = '.';
+      memcpy(buf + n, digits + 1, ndigit - 1);
+      n += ndigit - 1;
+    }
+
+    buf[n++] = 'e';
+    if (sci < 0)
+    {
+      buf[n++] = '-';
+      sci = -sci;
+    }
+
+    if (sci >= 100) buf[n++] = (char)('0' + sci / 100);
+    if (sci >= 10) buf[n++] = (char)('0' + (sci / 10) % 10);
+    buf[n++] = (char)('0' + sci % 10);
+  }
+  else if (exp >= 0)
+  {
+    /* integer */
+    memcpy(buf + n, digits, ndigit);
+    n += ndigit;
+    for (i = 0; i != (uint32_t)exp; ++i) buf[n++] = '0';
+  }
+  else if (sci >= 0)
+  {
+    memcpy(buf + n, digits, sci + 1);
+    n += sci + 1;
+    buf[n++] = '.';
+    memcpy(buf + n, digits + sci + 1, ndigit - sci - 1);
+    n += ndigit - sci - 1;
+  }
+  else
+  {
+    buf[n++] = '0';
+    buf[n++] = '.';
+    for (i = 0; i != (uint32_t)(-sci - 1); ++i) buf[n++] = '0';
+    memcpy(buf + n, digits, ndigit);
+    n += ndigit;
+  }
+
+  buf[n] = 0;
+
+  return n;
+}
+
+
+#if DTOA_CONFIG_UNIT /* unit */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+int main(int ac, char** av)
+{
+  /* compare against the shortest %.*g that parses back */
+
+  char buf[DTOA_MAX_LEN];
+  char ref[DTOA_MAX_LEN];
+  size_t count = 0;
+  size_t i;
+  uint64_t bits;
+  double x;
+  double y;
+  int prec;
+
+  dtoa_init();
+
+  for (i = 0; i != 1000000; ++i)
+  {
+    bits = ((uint64_t)rand() << 62) ^ ((uint64_t)rand() << 31) ^ rand();
+    if (i & 1)
+    {
+      /* exponents around 0 */
+      bits &= ~(0x7ffULL << 52);
+      bits |= (uint64_t)(1023 + rand() % 64 - 32) << 52;
+    }
+    memcpy(&x, &bits, sizeof(double));
+    if (x != x) continue ;
+
+    dtoa_shortest(buf, x);
+    y = strtod(buf, NULL);
+
+    for (prec = 1; prec != 18; ++prec)
+    {
+      snprintf(ref, sizeof(ref), "%.*g", prec, x);
+      if (strtod(ref, NULL) == x) break ;
+    }
+
+    if ((memcmp(&x, &y, sizeof(double)) != 0) ||
+	(strtold(ref, NULL) != strtold(buf, NULL)))
+    {
+      printf("%s %s %.17g\n", buf, ref, x);
+      ++count;
+    }
+  }
+
+  printf("%zu errors\n", count);
+
+  return 0;
+}
+
+#endif /* DTOA_CONFIG_UNIT */
@@ -0,0 +1,16 @@
+#ifndef DTOA_H_INCLUDED
+#define DTOA_H_INCLUDED
+
+
+#include <sys/types.h>
+
+
+/* longest formatted double, including the terminating 0 */
+#define DTOA_MAX_LEN 32
+
+
+void dtoa_init(void);
+size_t dtoa_shortest(char*, double);
+
+
+#endif /* DTOA_H_INCLUDED */
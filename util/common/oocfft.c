@@ -0,0 +1,405 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <string.h>
+#include <limits.h>
+#include <math.h>
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <fftw3.h>
+#include "oocfft.h"
+
+
+/* out of core real fft, for signals larger than memory. the input is
+   appended to a temporary file, zero padded to n = 2^k samples, and
+   seen as m = n / 2 complex values z[j] = x[2j] + i * x[2j + 1].
+   the m point fft uses the six step algorithm, with m = m1 * m2:
+   1. transpose the m1 x m2 matrix z[j1 * m2 + j2]
+   2. m2 ffts of length m1, along rows, times w_m^(j2 * k1)
+   3. transpose back
+   4. m1 ffts of length m2, along rows
+   5. transpose, giving z[k1 + m1 * k2] in natural order
+   a last pass splits z into the n / 2 + 1 bins of the real transform.
+   passes go between two mapped files, by blocks of rows or by tiles
+   of page sized rows, and processed pages are dropped from the
+   mapping so that the resident size does not depend on n.
+ */
+
+#define OOCFFT_TILE 256
+#define OOCFFT_SUBTILE 32
+
+
+/* twiddles. w_l^p = lo[p % s] * hi[p / s], tables of sqrt(l) entries.
+   l and s are powers of 2. */
+
+typedef struct twiddle
+{
+  size_t l;
+  size_t s;
+  unsigned int log2_s;
+  fftw_complex* lo;
+  fftw_complex* hi;
+} twiddle_t;
+
+static void set_root(fftw_complex w, size_t p, size_t l)
+{
+  const double a = -2.0 * M_PI * (double)p / (double)l;
+  w[0] = cos(a);
+  w[1] = sin(a);
+}
+
+static int twiddle_init(twiddle_t* tw, size_t l, size_t s)
+{
+  size_t i;
+
+  tw->l = l;
+  tw->s = s;
+  for (tw->log2_s = 0; ((size_t)1 << tw->log2_s) != s; ++tw->log2_s) ;
+
+  tw->lo = malloc(s * sizeof(fftw_complex));
+  if (tw->lo == NULL) goto on_error_0;
+
+  tw->hi = malloc((l / s) * sizeof(fftw_complex));
+  if (tw->hi == NULL) goto on_error_1;
+
+  for (i = 0; i != s; ++i) set_root(tw->lo[i], i, l);
+  for (i = 0; i != (l / s); ++i) set_root(tw->hi[i], i * s, l);
+
+  return 0;
+
+ on_error_1:
+  free(tw->lo);
+ on_error_0:
+  return -1;
+}
+
+static void twiddle_fini(twiddle_t* tw)
+{
+  free(tw->hi);
+  free(tw->lo);
+}
+
+static inline void twiddle_mul(const twiddle_t* tw, size_t p, fftw_complex z)
+{
+  /* z *= w_l^p */
+
+  const double* const a = tw->lo[p & (tw->s - 1)];
+  const double* const b = tw->hi[p >> tw->log2_s];
+  const double wr = a[0] * b[0] - a[1] * b[1];
+  const double wi = a[0] * b[1] + a[1] * b[0];
+  const double zr = z[0];
+
+  z[0] = zr * wr - z[1] * wi;
+  z[1] = zr * wi + z[1] * wr;
+}
+
+
+/* mapped pages */
+
+static void drop_pages(void* p, size_t len)
+{
+  /* processed, written back from the page cache when needed */
+
+  const size_t page = (size_t)sysconf(_SC_PAGESIZE);
+  const uintptr_t lo = (uintptr_t)p & ~(page - 1);
+  const uintptr_t hi = ((uintptr_t)p + len + page - 1) & ~(page - 1);
+
+  madvise((void*)lo, hi - lo, MADV_DONTNEED);
+}
+
+
+/* passes */
+
+static void transpose
+(fftw_complex* dst, fftw_complex* src, size_t r, size_t c)
+{
+  /* src the r x c matrix, dst the c x r one */
+  /* a tile row is OOCFFT_TILE * 16 bytes, ie. a page */
+
+  const size_t t = (r < OOCFFT_TILE) ? r : OOCFFT_TILE;
+  const size_t u = (c < OOCFFT_TILE) ? c : OOCFFT_TILE;
+  size_t i0;
+  size_t j0;
+  size_t i1;
+  size_t j1;
+  size_t i;
+  size_t j;
+
+  for (i0 = 0; i0 != r; i0 += t)
+  {
+    for (j0 = 0; j0 != c; j0 += u)
+    {
+      /* sub tiles, for the cache */
+      for (i1 = i0; i1 < (i0 + t); i1 += OOCFFT_SUBTILE)
+      {
+	for (j1 = j0; j1 < (j0 + u); j1 += OOCFFT_SUBTILE)
+	{
+	  for (i = i1; (i != (i1 + OOCFFT_SUBTILE)) && (i != (i0 + t)); ++i)
+	  {
+	    for (j = j1; (j != (j1 + OOCFFT_SUBTILE)) && (j != (j0 + u)); ++j)
+	    {
+	      dst[j * r + i][0] = src[i * c + j][0];
+	      dst[j * r + i][1] = src[i * c + j][1];
+	    }
+	  }
+	}
+      }
+    }
+
+    /* the src band is done, and a page of each dst row */
+    drop_pages(src + i0 * c, t * c * sizeof(fftw_complex));
+    drop_pages(dst, r * c * sizeof(fftw_complex));
+  }
+}
+
+static int fft_rows
+(fftw_complex* a, size_t r, size_t c, const twiddle_t* tw, unsigned int flags)
+{
+  /* in place length c ffts of the r rows of a, by blocks of rows */
+  /* tw not NULL to multiply a[i][j] by w_m^(i * j) */
+
+  const int nc = (int)c;
+  fftw_complex* tmp;
+  fftw_plan plan;
+  size_t nrow;
+  size_t i;
+  size_t j;
+  size_t k;
+
+  /* powers of 2, nrow divides r */
+  nrow = OOCFFT_BLOCK_SIZE / (c * sizeof(fftw_complex));
+  if (nrow == 0) nrow = 1;
+  if (nrow > r) nrow = r;
+
+  /* planned on a scratch block, executed on the mapping */
+  tmp = fftw_malloc(nrow * c * sizeof(fftw_complex));
+  if (tmp == NULL) goto on_error_0;
+
+  plan = fftw_plan_many_dft
+  (
+   1, &nc, (int)nrow,
+   tmp, NULL, 1, nc,
+   tmp, NULL, 1, nc,
+   FFTW_FORWARD, flags
+  );
+  if (plan == NULL) goto on_error_1;
+
+  for (i = 0; i != r; i += nrow)
+  {
+    fftw_complex* const p = a + i * c;
+
+    fftw_execute_dft(plan, p, p);
+
+    if (tw != NULL)
+    {
+      for (j = 0; j != nrow; ++j)
+      {
+	for (k = 0; k != c; ++k)
+	  twiddle_mul(tw, (i + j) * k, p[j * c + k]);
+      }
+    }
+
+    drop_pages(p, nrow * c * sizeof(fftw_complex));
+  }
+
+  fftw_destroy_plan(plan);
+  fftw_free(tmp);
+
+  return 0;
+
+ on_error_1:
+  fftw_free(tmp);
+ on_error_0:
+  return -1;
+}
+
+static int split_real(fftw_complex* x, fftw_complex* z, size_t m, size_t n)
+{
+  /* z the m point fft of the packed signal, x the n / 2 + 1 bins */
+  /* x[k] = e[k] + w_n^k * o[k], with e and o the even and odd parts:
+     e[k] = (z[k] + conj(z[m - k])) / 2
+     o[k] = -i * (z[k] - conj(z[m - k])) / 2
+     bins k and m - k are computed together, from both file ends.
+   */
+
+  const size_t nk = OOCFFT_BLOCK_SIZE / (4 * sizeof(fftw_complex));
+  twiddle_t tw;
+  size_t s;
+  size_t k0;
+  size_t k;
+
+  for (s = 1; (s * s) < n; s *= 2) ;
+  if (twiddle_init(&tw, n, s)) return -1;
+
+  for (k0 = 0; k0 <= (m / 2); k0 += nk)
+  {
+    for (k = k0; (k != (k0 + nk)) && (k <= (m / 2)); ++k)
+    {
+      const size_t kk = m - k;
+      const double ar = z[k][0];
+      const double ai = z[k][1];
+      const double br = z[kk % m][0];
+      const double bi = -z[kk % m][1];
+      fftw_complex o;
+      fftw_complex oo;
+
+      /* e[k] = (a + b) / 2, o[k] = -i (a - b) / 2, b = conj(z[m - k]) */
+      const double er = (ar + br) / 2;
+      const double ei = (ai + bi) / 2;
+      o[0] = (ai - bi) / 2;
+      o[1] = -(ar - br) / 2;
+
+      /* for m - k: e = conj(e[k]), o = conj(o[k]) */
+      oo[0] = o[0];
+      oo[1] = -o[1];
+
+      twiddle_mul(&tw, k, o);
+      twiddle_mul(&tw, kk, oo);
+
+      x[k][0] = er + o[0];
+      x[k][1] = ei + o[1];
+      x[kk][0] = er + oo[0];
+      x[kk][1] = -ei + oo[1];
+    }
+
+    /* both ends are done */
+    if ((k0 + nk) < m)
+    {
+      drop_pages(z + k0, nk * sizeof(fftw_complex));
+      drop_pages(x + k0, nk * sizeof(fftw_complex));
+      drop_pages(z + m - k0 - nk, nk * sizeof(fftw_complex));
+      drop_pages(x + m - k0 - nk, nk * sizeof(fftw_complex));
+    }
+  }
+
+  twiddle_fini(&tw);
+
+  return 0;
+}
+
+
+/* exported */
+
+int oocfft_open(oocfft_t* o, const char* dir)
+{
+  /* dir the temporary directory, NULL for /tmp */
+
+  char path[PATH_MAX];
+  size_t i;
+
+  if (dir == NULL) dir = "/tmp";
+
+  for (i = 0; i != 2; ++i)
+  {
+    snprintf(path, sizeof(path), "%s/oocfft_XXXXXX", dir);
+    o->fd[i] = mkstemp(path);
+    if (o->fd[i] == -1) goto on_error;
+    unlink(path);
+  }
+
+  o->n = 0;
+  o->count = 0;
+  o->map[0] = NULL;
+  o->map[1] = NULL;
+
+  return 0;
+
+ on_error:
+  if (i) close(o->fd[0]);
+  return -1;
+}
+
+int oocfft_write(oocfft_t* o, const double* x, size_t n)
+{
+  /* append n real samples, sequentially */
+
+  const uint8_t* p = (const uint8_t*)x;
+  size_t len = n * sizeof(double);
+  ssize_t k;
+
+  for (; len; len -= (size_t)k, p += k)
+  {
+    k = write(o->fd[0], p, len);
+    if (k <= 0) return -1;
+  }
+
+  o->count += n;
+
+  return 0;
+}
+
+int oocfft_exec(oocfft_t* o, unsigned int flags)
+{
+  /* flags the fftw planner flags */
+
+  twiddle_t tw;
+  size_t lm;
+  size_t i;
+
+  /* n a power of 2, at least 4. the file tail is read as zeros. */
+
+  for (o->n = 4; o->n < o->count; o->n *= 2) ;
+  o->m = o->n / 2;
+  for (lm = 0; ((size_t)1 << lm) != o->m; ++lm) ;
+  o->m1 = (size_t)1 << (lm / 2);
+  o->m2 = o->m / o->m1;
+
+  /* the split pass writes m + 1 bins */
+  o->size = (o->m + 1) * sizeof(fftw_complex);
+
+  for (i = 0; i != 2; ++i)
+  {
+    if (ftruncate(o->fd[i], (off_t)o->size)) goto on_error_0;
+
+    o->map[i] = mmap
+      (NULL, o->size, PROT_READ | PROT_WRITE, MAP_SHARED, o->fd[i], 0);
+    if (o->map[i] == MAP_FAILED)
+    {
+      o->map[i] = NULL;
+      goto on_error_0;
+    }
+  }
+
+  if (twiddle_init(&tw, o->m, o->m1)) goto on_error_0;
+
+  transpose(o->map[1], o->map[0], o->m1, o->m2);
+  if (fft_rows(o->map[1], o->m2, o->m1, &tw, flags)) goto on_error_1;
+  transpose(o->map[0], o->map[1], o->m2, o->m1);
+  if (fft_rows(o->map[0], o->m1, o->m2, NULL, flags)) goto on_error_1;
+  transpose(o->map[1], o->map[0], o->m1, o->m2);
+
+  if (split_real(o->map[0], o->map[1], o->m, o->n)) goto on_error_1;
+
+  twiddle_fini(&tw);
+
+  return 0;
+
+ on_error_1:
+  twiddle_fini(&tw);
+ on_error_0:
+  return -1;
+}
+
+int oocfft_read(oocfft_t* o, fftw_complex* x, size_t k, size_t n)
+{
+  /* copy the bins [k, k + n[, out of n / 2 + 1 */
+
+  if ((k + n) > (o->m + 1)) return -1;
+
+  memcpy(x, o->map[0] + k, n * sizeof(fftw_complex));
+  drop_pages(o->map[0] + k, n * sizeof(fftw_complex));
+
+  return 0;
+}
+
+void oocfft_close(oocfft_t* o)
+{
+  size_t i;
+
+  for (i = 0; i != 2; ++i)
+  {
+    if (o->map[i] != NULL) munmap(o->map[i], o->size);
+    close(o->fd[i]);
+  }
+}
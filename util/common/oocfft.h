@@ -0,0 +1,38 @@
+#ifndef OOCFFT_H_INCLUDED
+#define OOCFFT_H_INCLUDED
+
+
+#include <sys/types.h>
+#include <fftw3.h>
+
+
+/* bytes of rows transformed at once, about the resident size */
+#define OOCFFT_BLOCK_SIZE (1 << 22)
+
+typedef struct oocfft
+{
+  /* real length n, a power of 2, as m = n / 2 = m1 * m2 complex */
+  size_t n;
+  size_t m;
+  size_t m1;
+  size_t m2;
+
+  /* real samples written so far */
+  size_t count;
+
+  /* unlinked temporary files, mapped once the input is complete */
+  int fd[2];
+  fftw_complex* map[2];
+  size_t size;
+
+} oocfft_t;
+
+
+int oocfft_open(oocfft_t*, const char*);
+int oocfft_write(oocfft_t*, const double*, size_t);
+int oocfft_exec(oocfft_t*, unsigned int);
+int oocfft_read(oocfft_t*, fftw_complex*, size_t, size_t);
+void oocfft_close(oocfft_t*);
+
+
+#endif /* OOCFFT_H_INCLUDED */
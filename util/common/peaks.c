@@ -0,0 +1,191 @@
+#include <stdlib.h>
+#include <math.h>
+#include <sys/types.h>
+#include "peaks.h"
+
+
+/* top k peaks of a power spectrum. the candidates are the local maxima
+   above the threshold. they are heapified in linear time and popped in
+   decreasing power order, skipping the ones closer than sep bins to an
+   already selected peak, until k are selected. only a few candidates
+   are popped, so that the cost is about linear in the bin count.
+ */
+
+static void sift_down(size_t* h, size_t n, size_t i, const double* ps)
+{
+  /* max heap of bins, ordered by power */
+
+  const size_t x = h[i];
+  size_t j;
+
+  for (; (j = 2 * i + 1) < n; i = j)
+  {
+    if (((j + 1) < n) && (ps[h[j + 1]] > ps[h[j]])) ++j;
+    if (ps[h[j]] <= ps[x]) break ;
+    h[i] = h[j];
+  }
+
+  h[i] = x;
+}
+
+static int is_separated
+(const peak_t* peaks, size_t k, size_t bin, size_t sep)
+{
+  size_t i;
+
+  for (i = 0; i != k; ++i)
+  {
+    const size_t d =
+      (peaks[i].bin > bin) ? (peaks[i].bin - bin) : (bin - peaks[i].bin);
+    if (d < sep) return 0;
+  }
+
+  return 1;
+}
+
+int peaks_find
+(
+ peak_t* peaks, size_t* k,
+ const double* ps, size_t n,
+ size_t sep, double thresh,
+ size_t* cand
+)
+{
+  /* peaks the *k strongest peaks, *k updated to the found count */
+  /* sep the minimum bin distance between 2 peaks, 0 or 1 for none */
+  /* cand scratch of (n + 1) / 2 entries, or NULL to allocate */
+
+  size_t* h = cand;
+  size_t nh;
+  size_t npeak;
+  size_t i;
+
+  if (h == NULL)
+  {
+    h = malloc(((n + 1) / 2) * sizeof(size_t));
+    if (h == NULL) return -1;
+  }
+
+  /* local maxima, the first bin of a plateau */
+
+  nh = 0;
+  for (i = 0; i != n; ++i)
+  {
+    if (ps[i] < thresh) continue ;
+    if ((i != 0) && (ps[i] <= ps[i - 1])) continue ;
+    if (((i + 1) != n) && (ps[i] < ps[i + 1])) continue ;
+    h[nh++] = i;
+  }
+
+  for (i = nh / 2; i != 0; --i) sift_down(h, nh, i - 1, ps);
+
+  /* pop in decreasing power order */
+
+  for (npeak = 0; (npeak != *k) && nh; )
+  {
+    i = h[0];
+    h[0] = h[--nh];
+    sift_down(h, nh, 0, ps);
+
+    if (is_separated(peaks, npeak, i, sep) == 0) continue ;
+
+    peaks[npeak].bin = i;
+    peaks[npeak].power = ps[i];
+    peaks[npeak].delta = 0;
+    ++npeak;
+  }
+
+  *k = npeak;
+
+  if (cand == NULL) free(h);
+
+  return 0;
+}
+
+
+/* sub bin interpolation, from the peak bin and its 2 neighbors. a
+   parabola through the magnitudes (quadratic) or their logarithms
+   (gaussian, exact for a gaussian window), or jacobsen estimator on
+   the complex bins, which has the smallest bias for a rectangular
+   window.
+ */
+
+static double clamp_delta(double d)
+{
+  if (isnan(d)) return 0;
+  if (d < -0.5) return -0.5;
+  if (d > 0.5) return 0.5;
+  return d;
+}
+
+void peaks_interp
+(
+ peak_t* peaks, size_t npeak,
+ const double* ps, const double* xx, size_t n,
+ int method
+)
+{
+  /* ps the n magnitudes, xx the n complex bins, interleaved */
+  /* xx is only needed by PEAKS_INTERP_JACOBSEN, and may be NULL */
+
+  double a;
+  double b;
+  double c;
+  double d;
+  double re;
+  double im;
+  double nre;
+  double nim;
+  double den;
+  size_t i;
+  size_t k;
+
+  for (i = 0; i != npeak; ++i)
+  {
+    k = peaks[i].bin;
+    peaks[i].delta = 0;
+
+    if ((k == 0) || ((k + 1) >= n)) continue ;
+
+    switch (method)
+    {
+    case PEAKS_INTERP_QUADRATIC:
+      a = ps[k - 1];
+      b = ps[k];
+      c = ps[k + 1];
+      den = a - 2 * b + c;
+      if (den == 0) break ;
+      d = clamp_delta(0.5 * (a - c) / den);
+      peaks[i].delta = d;
+      peaks[i].power = b - 0.25 * (a - c) * d;
+      break ;
+
+    case PEAKS_INTERP_GAUSSIAN:
+      if ((ps[k - 1] <= 0) || (ps[k] <= 0) || (ps[k + 1] <= 0)) break ;
+      a = log(ps[k - 1]);
+      b = log(ps[k]);
+      c = log(ps[k + 1]);
+      den = a - 2 * b + c;
+      if (den == 0) break ;
+      d = clamp_delta(0.5 * (a - c) / den);
+      peaks[i].delta = d;
+      peaks[i].power = exp(b - 0.25 * (a - c) * d);
+      break ;
+
+    case PEAKS_INTERP_JACOBSEN:
+      /* d = re((x[k - 1] - x[k + 1]) / (2 x[k] - x[k - 1] - x[k + 1])) */
+      if (xx == NULL) break ;
+      nre = xx[(k - 1) * 2 + 0] - xx[(k + 1) * 2 + 0];
+      nim = xx[(k - 1) * 2 + 1] - xx[(k + 1) * 2 + 1];
+      re = 2 * xx[k * 2 + 0] - xx[(k - 1) * 2 + 0] - xx[(k + 1) * 2 + 0];
+      im = 2 * xx[k * 2 + 1] - xx[(k - 1) * 2 + 1] - xx[(k + 1) * 2 + 1];
+      den = re * re + im * im;
+      if (den == 0) break ;
+      peaks[i].delta = clamp_delta((nre * re + nim * im) / den);
+      break ;
+
+    default:
+      break ;
+    }
+  }
+}
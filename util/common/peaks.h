@@ -0,0 +1,30 @@
+#ifndef PEAKS_H_INCLUDED
+#define PEAKS_H_INCLUDED
+
+
+#include <sys/types.h>
+
+
+/* sub bin interpolation methods */
+#define PEAKS_INTERP_NONE 0
+#define PEAKS_INTERP_QUADRATIC 1
+#define PEAKS_INTERP_GAUSSIAN 2
+#define PEAKS_INTERP_JACOBSEN 3
+
+typedef struct peak
+{
+  size_t bin;
+  double power;
+
+  /* interpolated position is bin + delta, delta in [-0.5, 0.5] */
+  double delta;
+} peak_t;
+
+
+int peaks_find
+(peak_t*, size_t*, const double*, size_t, size_t, double, size_t*);
+void peaks_interp
+(peak_t*, size_t, const double*, const double*, size_t, int);
+
+
+#endif /* PEAKS_H_INCLUDED */
@@ -0,0 +1,154 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <pthread.h>
+#include "pool.h"
+
+
+/* fixed size thread pool. pool_run hands out ntask task indices to the
+   workers and the calling thread, and returns once they are all done.
+   a task may use per worker scratch, indexed by its worker argument.
+ */
+
+typedef struct worker_arg
+{
+  pool_t* pool;
+  size_t worker;
+} worker_arg_t;
+
+static void run_tasks(pool_t* pool, size_t worker)
+{
+  /* called and returns with the lock held */
+
+  const pool_fn_t fn = pool->fn;
+  void* const arg = pool->arg;
+  size_t task;
+
+  while (pool->next != pool->ntask)
+  {
+    task = pool->next++;
+
+    pthread_mutex_unlock(&pool->lock);
+    fn(arg, task, worker);
+    pthread_mutex_lock(&pool->lock);
+
+    if (++pool->ndone == pool->ntask) pthread_cond_broadcast(&pool->cond);
+  }
+}
+
+static void* worker_entry(void* p)
+{
+  worker_arg_t* const wa = p;
+  pool_t* const pool = wa->pool;
+  const size_t worker = wa->worker;
+  unsigned int gen = 0;
+
+  free(wa);
+
+  pthread_mutex_lock(&pool->lock);
+
+  while (1)
+  {
+    while ((pool->gen == gen) && (pool->is_done == 0))
+      pthread_cond_wait(&pool->cond, &pool->lock);
+
+    if (pool->is_done) break ;
+
+    gen = pool->gen;
+    run_tasks(pool, worker);
+  }
+
+  pthread_mutex_unlock(&pool->lock);
+
+  return NULL;
+}
+
+int pool_create(pool_t* pool, size_t nthread)
+{
+  /* nthread the worker count, including the caller. 0 for cpu count. */
+
+  worker_arg_t* wa;
+  long ncpu;
+
+  if (nthread == 0)
+  {
+    ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    nthread = (ncpu < 1) ? 1 : (size_t)ncpu;
+  }
+
+  if (nthread > POOL_MAX_THREADS) nthread = POOL_MAX_THREADS;
+
+  pthread_mutex_init(&pool->lock, NULL);
+  pthread_cond_init(&pool->cond, NULL);
+
+  pool->fn = NULL;
+  pool->arg = NULL;
+  pool->ntask = 0;
+  pool->next = 0;
+  pool->ndone = 0;
+  pool->gen = 0;
+  pool->is_done = 0;
+
+  /* threads[0] unused, worker 0 is the caller */
+  for (pool->nthread = 1; pool->nthread != nthread; ++pool->nthread)
+  {
+    wa = malloc(sizeof(worker_arg_t));
+    if (wa == NULL) goto on_error;
+
+    wa->pool = pool;
+    wa->worker = pool->nthread;
+
+    if (pthread_create(&pool->threads[pool->nthread], NULL, worker_entry, wa))
+    {
+      free(wa);
+      goto on_error;
+    }
+  }
+
+  return 0;
+
+ on_error:
+  pool_destroy(pool);
+  return -1;
+}
+
+int pool_run(pool_t* pool, pool_fn_t fn, void* arg, size_t ntask)
+{
+  if (ntask == 0) return 0;
+
+  pthread_mutex_lock(&pool->lock);
+
+  pool->fn = fn;
+  pool->arg = arg;
+  pool->ntask = ntask;
+  pool->next = 0;
+  pool->ndone = 0;
+  ++pool->gen;
+
+  if (pool->nthread > 1) pthread_cond_broadcast(&pool->cond);
+
+  run_tasks(pool, 0);
+
+  while (pool->ndone != pool->ntask)
+    pthread_cond_wait(&pool->cond, &pool->lock);
+
+  pthread_mutex_unlock(&pool->lock);
+
+  return 0;
+}
+
+void pool_destroy(pool_t* pool)
+{
+  size_t i;
+
+  pthread_mutex_lock(&pool->lock);
+  pool->is_done = 1;
+  pthread_cond_broadcast(&pool->cond);
+  pthread_mutex_unlock(&pool->lock);
+
+  for (i = 1; i != pool->nthread; ++i) pthread_join(pool->threads[i], NULL);
+
+  pthread_cond_destroy(&pool->cond);
+  pthread_mutex_destroy(&pool->lock);
+}
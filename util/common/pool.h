@@ -0,0 +1,40 @@
+#ifndef POOL_H_INCLUDED
+#define POOL_H_INCLUDED
+
+
+#include <sys/types.h>
+#include <pthread.h>
+
+
+#define POOL_MAX_THREADS 64
+
+/* task routine. task in [0, ntask[, worker in [0, nthread[ */
+typedef void (*pool_fn_t)(void*, size_t, size_t);
+
+typedef struct pool
+{
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+
+  /* current job, tasks handed out from next */
+  pool_fn_t fn;
+  void* arg;
+  size_t ntask;
+  size_t next;
+  size_t ndone;
+  unsigned int gen;
+  int is_done;
+
+  /* the calling thread is worker 0 */
+  pthread_t threads[POOL_MAX_THREADS];
+  size_t nthread;
+
+} pool_t;
+
+
+int pool_create(pool_t*, size_t);
+int pool_run(pool_t*, pool_fn_t, void*, size_t);
+void pool_destroy(pool_t*);
+
+
+#endif /* POOL_H_INCLUDED */
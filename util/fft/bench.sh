@@ -0,0 +1,32 @@
+#!/usr/bin/env sh
+
+# transform time against size and fftw thread count, to see where
+# threads stop paying off. inputs are generated once in BENCH_DIR.
+# planning is excluded, wisdom is kept across runs.
+
+dir=${BENCH_DIR:-/tmp/fft_bench}
+sizes=${BENCH_SIZES:-"16 18 20 22 24"}
+threads=${BENCH_THREADS:-"1 2 4 8"}
+
+mkdir -p $dir
+
+printf "%6s %8s %12s %8s\n" log2n threads transform speedup
+
+for l in $sizes; do
+  f=$dir/$l.dat
+  [ -f $f ] || awk -v n=$((1 << l)) \
+  'BEGIN { srand(1); for (i = 0; i < n; ++i) print sin(i * 0.01) + rand() }' \
+  > $f
+
+  ref=
+  for t in $threads; do
+    tt=`./a.out \
+    -ifile $f -icol 0 -fsampl 1 \
+    -threads $t -plan measure -wisdom $dir/wisdom -verbose 1 \
+    -ofile /dev/null 2>&1 | \
+    sed -n 's/.*transform \([^ ]*\) s.*/\1/p'`
+    [ -z "$ref" ] && ref=$tt
+    awk -v l=$l -v t=$t -v tt=$tt -v ref=$ref \
+    'BEGIN { printf("%6u %8u %12g %8.2f\n", l, t, tt, ref / tt) }'
+  done
+done
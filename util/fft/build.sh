@@ -1,3 +1,4 @@
 #!/usr/bin/env sh
 
-gcc -O2 -Wall fft.c ../common/csv.c -lm -lfftw3
+gcc -O2 -Wall -DCSV_CONFIG_ZLIB -DCSV_CONFIG_ZSTD \
+fft.c ../common/csv.c ../common/dtoa.c ../common/pool.c ../common/czt.c ../common/oocfft.c ../common/peaks.c -lm -lfftw3_threads -lfftw3 -lz -lzstd -lpthread
@@ -2,9 +2,18 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <math.h>
 #include <fftw3.h>
 #include "../common/csv.h"
+#include "../common/pool.h"
+#include "../common/czt.h"
+#include "../common/oocfft.h"
+#include "../common/peaks.h"
 
 
 #ifdef CONFIG_PERROR
@@ -94,30 +103,352 @@ static void fft_to_power_spectrum
 }
 
 
-/* compute the real dft using fft algorithm */
+/* output k peaks as frequency, power pairs. missing ones are nan.
+   frequencies include the sub bin interpolated offset. */
 
-static void fft
-(double* xx, const double* x, unsigned int n)
+static void put_peaks
+(
+ csv_writer_t* w,
+ const peak_t* peaks, size_t n, size_t k,
+ double flo, double fband
+)
+{
+  size_t i;
+
+  for (i = 0; i != k; ++i)
+  {
+    if (i < n)
+    {
+      const double bin = (double)peaks[i].bin + peaks[i].delta;
+      csv_writer_put(w, flo + fband * bin);
+      csv_writer_put(w, peaks[i].power);
+    }
+    else
+    {
+      csv_writer_put(w, NAN);
+      csv_writer_put(w, NAN);
+    }
+  }
+}
+
+
+/* compute the real dft of several signals using a single plan */
+
+static fftw_plan fft_plan
+(
+ fftw_complex* xx, double* x, size_t n, size_t howmany, size_t idist,
+ unsigned int flags
+)
 {
   /* n the size of the transform */
+  /* x the first signal, signal k starting at x + k * idist */
+  /* xx the n / 2 + 1 coeffs of each signal, one after the other */
+  /* flags other than FFTW_ESTIMATE overwrite x and xx */
+
+  const int nn = (int)n;
+
+  return fftw_plan_many_dft_r2c
+  (
+   1, &nn, (int)howmany,
+   x, NULL, 1, (int)idist,
+   xx, NULL, 1, nn / 2 + 1,
+   flags
+  );
+}
 
-  fftw_plan plan;
+static int czt_band
+(
+ fftw_complex* xx, double* x, size_t n, size_t howmany, size_t idist,
+ size_t m, double w0, double dw
+)
+{
+  /* m bins, from w0 by dw, in radians per sample */
+  /* xx the m coeffs of each signal, one after the other */
+
+  czt_t czt;
+  fftw_complex* in;
+  size_t i;
+  size_t j;
+
+  in = fftw_malloc(n * sizeof(fftw_complex));
+  if (in == NULL) return -1;
+
+  if (czt_init(&czt, n, m, w0, dw))
+  {
+    fftw_free(in);
+    return -1;
+  }
+
+  for (i = 0; i != howmany; ++i)
+  {
+    for (j = 0; j != n; ++j)
+    {
+      in[j][0] = x[i * idist + j];
+      in[j][1] = 0;
+    }
+
+    czt_exec(&czt, in, xx + i * m);
+  }
+
+  czt_fini(&czt);
+  fftw_free(in);
+
+  return 0;
+}
+
+static int czt_many
+(fftw_complex* xx, double* x, size_t n, size_t howmany, size_t idist)
+{
+  /* same as fft_plan and execute, for lengths fftw is slow with */
+
+  const double dw = 2.0 * M_PI / (double)n;
+  return czt_band(xx, x, n, howmany, idist, n / 2 + 1, 0.0, dw);
+}
+
+
+/* window functions */
+
+#define WINDOW_RECT 0
+#define WINDOW_HANN 1
+#define WINDOW_HAMMING 2
+#define WINDOW_BLACKMAN 3
+
+static void make_window(double* w, size_t n, int type)
+{
+  /* periodic form, as used for spectral analysis */
+
+  const double a = 2.0 * M_PI / (double)n;
+  size_t i;
+
+  for (i = 0; i != n; ++i)
+  {
+    switch (type)
+    {
+    case WINDOW_HANN:
+      w[i] = 0.5 - 0.5 * cos(a * (double)i);
+      break ;
+    case WINDOW_HAMMING:
+      w[i] = 0.54 - 0.46 * cos(a * (double)i);
+      break ;
+    case WINDOW_BLACKMAN:
+      w[i] = 0.42 - 0.5 * cos(a * (double)i) + 0.08 * cos(2.0 * a * (double)i);
+      break ;
+    default:
+      w[i] = 1.0;
+      break ;
+    }
+  }
+}
+
+
+/* phase vocoder refinement of stft peaks: the phase of a stationary
+   sinusoid advances by its frequency times the hop between 2 frames,
+   the deviation from the bin center advance gives the offset. it is
+   unambiguous within nwin / (2 * nhop) bins, so that hops up to nwin
+   / 2 cover the main lobe. frames without a previous one fall back to
+   quadratic interpolation.
+ */
+
+#define INTERP_VOCODER (PEAKS_INTERP_JACOBSEN + 1)
+
+static void vocoder_interp
+(
+ peak_t* peaks, size_t npeak,
+ const fftw_complex* prev, const fftw_complex* cur,
+ size_t nwin, size_t nhop
+)
+{
+  const double a = 2.0 * M_PI * (double)nhop / (double)nwin;
+  double dphi;
+  size_t i;
+  size_t k;
+
+  for (i = 0; i != npeak; ++i)
+  {
+    k = peaks[i].bin;
+
+    dphi = atan2(cur[k][1], cur[k][0]) - atan2(prev[k][1], prev[k][0]);
+    dphi -= a * (double)k;
+
+    /* wrap to [-pi, pi] */
+    dphi -= 2.0 * M_PI * floor(dphi / (2.0 * M_PI) + 0.5);
+
+    peaks[i].delta = dphi / a;
+  }
+}
+
+
+/* short time fourier transform. the signal is read as a stream and
+   frames are transformed by batches: each pool task windows and
+   transforms STFT_TASK_FRAMES consecutive frames with a single many
+   plan, so that a batch holds nthread * STFT_TASK_FRAMES frames and
+   memory does not depend on the capture length.
+ */
+
+#define STFT_TASK_FRAMES 16
+#define STFT_READ_LINES 4096
+
+typedef struct stft
+{
+  size_t nwin;
+  size_t nhop;
+  size_t nbin;
+  const double* win;
+
+  /* signal buffer. frame i starts at sig + i * nhop. */
+  double* sig;
+  size_t nsig;
+  size_t size;
+
+  /* complete frames in the current batch, frames output so far */
+  size_t nframe;
+  size_t iframe;
+
+  /* first sample position and sampling frequency, for row times */
+  size_t lo;
+  double fsampl;
+
+  /* per task input and output, nbin power per frame */
+  double* in;
   fftw_complex* out;
-  unsigned int i;
+  double* ps;
+
+  /* npeak peaks per frame instead of all bins, if not 0. cand is the
+     peaks_find scratch of each worker, of ncand entries. */
+  size_t npeak;
+  size_t sep;
+  double thresh;
+  peak_t* peaks;
+  size_t* found;
+  size_t* cand;
+  size_t ncand;
+
+  /* PEAKS_INTERP_xxx or INTERP_VOCODER. prev the last frame of the
+     previous batch, for the vocoder phase difference. */
+  int interp;
+  fftw_complex* prev;
+  int has_prev;
+
+  /* STFT_TASK_FRAMES transforms, executed on task arrays */
+  fftw_plan plan;
+
+} stft_t;
+
+static void stft_task(void* arg, size_t task, size_t worker)
+{
+  stft_t* const st = arg;
+  const size_t lo = task * STFT_TASK_FRAMES;
+  double* const in = st->in + lo * st->nwin;
+  fftw_complex* const out = st->out + lo * st->nbin;
+  double* xx;
+  size_t nframe;
+  size_t i;
+  size_t j;
+
+  nframe = st->nframe - lo;
+  if (nframe > STFT_TASK_FRAMES) nframe = STFT_TASK_FRAMES;
+
+  for (i = 0; i != STFT_TASK_FRAMES; ++i)
+  {
+    const double* const x = st->sig + (lo + i) * st->nhop;
+    double* const y = in + i * st->nwin;
+
+    if (i >= nframe)
+    {
+      /* unused frames of the last batch */
+      for (j = 0; j != st->nwin; ++j) y[j] = 0;
+      continue ;
+    }
+
+    for (j = 0; j != st->nwin; ++j) y[j] = x[j] * st->win[j];
+  }
+
+  fftw_execute_dft_r2c(st->plan, in, out);
+
+  for (i = 0; i != nframe; ++i)
+  {
+    double* const ps = st->ps + (lo + i) * st->nbin;
+
+    xx = (double*)(out + i * st->nbin);
+    fft_to_power_spectrum(ps, xx, st->nbin);
+
+    if (st->npeak)
+    {
+      st->found[lo + i] = st->npeak;
+      peaks_find
+      (
+       st->peaks + (lo + i) * st->npeak, st->found + lo + i,
+       ps, st->nbin, st->sep, st->thresh,
+       st->cand + worker * st->ncand
+      );
+
+      peaks_interp
+      (
+       st->peaks + (lo + i) * st->npeak, st->found[lo + i],
+       ps, xx, st->nbin,
+       (st->interp == INTERP_VOCODER) ? PEAKS_INTERP_QUADRATIC : st->interp
+      );
+    }
+  }
+}
+
+static int stft_flush(stft_t* st, pool_t* pool, csv_writer_t* w)
+{
+  /* transform the complete frames in sig, output one row per frame */
+
+  size_t ntask;
+  size_t i;
+  size_t j;
 
-  out = fftw_malloc((n / 2 + 1) * sizeof(fftw_complex));
-  plan = fftw_plan_dft_r2c_1d(n, (double*)x, out, FFTW_ESTIMATE);
+  if (st->nsig < st->nwin) return 0;
 
-  fftw_execute(plan);
+  st->nframe = (st->nsig - st->nwin) / st->nhop + 1;
+  ntask = (st->nframe + STFT_TASK_FRAMES - 1) / STFT_TASK_FRAMES;
+  pool_run(pool, stft_task, st, ntask);
 
-  for (i = 0; i < n / 2 + 1; ++i)
+  if (st->npeak && (st->interp == INTERP_VOCODER))
   {
-    xx[i * 2 + 0] = out[i][0];
-    xx[i * 2 + 1] = out[i][1];
+    for (i = 0; i != st->nframe; ++i)
+    {
+      const fftw_complex* const cur = st->out + i * st->nbin;
+      const fftw_complex* const prev = i ? (cur - st->nbin) : st->prev;
+
+      if ((i == 0) && (st->has_prev == 0)) continue ;
+
+      vocoder_interp
+      (
+       st->peaks + i * st->npeak, st->found[i],
+       prev, cur, st->nwin, st->nhop
+      );
+    }
+
+    /* the next batch first frame follows this one last */
+    memcpy
+    (
+     st->prev, st->out + (st->nframe - 1) * st->nbin,
+     st->nbin * sizeof(fftw_complex)
+    );
+    st->has_prev = 1;
+  }
+
+  for (i = 0; i != st->nframe; ++i, ++st->iframe)
+  {
+    const double* const ps = st->ps + i * st->nbin;
+    csv_writer_put(w, (double)(st->lo + st->iframe * st->nhop) / st->fsampl);
+    if (st->npeak)
+    {
+      const double fband = st->fsampl / (double)st->nwin;
+      const peak_t* const peaks = st->peaks + i * st->npeak;
+      put_peaks(w, peaks, st->found[i], st->npeak, 0.0, fband);
+    }
+    else
+    {
+      for (j = 0; j != st->nbin; ++j) csv_writer_put(w, ps[j]);
+    }
+    csv_writer_endl(w);
   }
 
-  fftw_destroy_plan(plan);
-  fftw_free(out);
+  return w->is_error ? -1 : 0;
 }
 
 
@@ -153,6 +484,24 @@ typedef struct
 #define CMDLINE_FLAG_IFILE (1 << 3)
 #define CMDLINE_FLAG_OFILE (1 << 4)
 #define CMDLINE_FLAG_ICOL (1 << 5)
+#define CMDLINE_FLAG_DELIM (1 << 6)
+#define CMDLINE_FLAG_OFORMAT (1 << 7)
+#define CMDLINE_FLAG_STFT (1 << 8)
+#define CMDLINE_FLAG_WINDOW (1 << 9)
+#define CMDLINE_FLAG_THREADS (1 << 10)
+#define CMDLINE_FLAG_FLEN (1 << 11)
+#define CMDLINE_FLAG_FZOOM (1 << 12)
+#define CMDLINE_FLAG_PLAN (1 << 13)
+#define CMDLINE_FLAG_WISDOM (1 << 14)
+#define CMDLINE_FLAG_OOC (1 << 15)
+#define CMDLINE_FLAG_PEAKS (1 << 16)
+#define CMDLINE_FLAG_PEAK_SEP (1 << 17)
+#define CMDLINE_FLAG_PEAK_MIN (1 << 18)
+#define CMDLINE_FLAG_INTERP (1 << 19)
+#define CMDLINE_FLAG_STREAM (1 << 20)
+#define CMDLINE_FLAG_IFORMAT (1 << 21)
+#define CMDLINE_FLAG_NCHAN (1 << 22)
+#define CMDLINE_FLAG_VERBOSE (1 << 23)
   uint32_t flags;
 
   double fsampl;
@@ -162,7 +511,57 @@ typedef struct
   const char* ifile;
   const char* ofile;
 
-  size_t icol;
+  /* input columns, transformed together */
+#define CMDLINE_MAX_ICOLS 64
+  size_t icols[CMDLINE_MAX_ICOLS];
+  size_t nicol;
+
+  csv_opts_t csv_opts;
+
+  /* CSV_WRITER_xxx */
+  int oformat;
+
+  /* stft window and hop, in samples */
+  size_t nwin;
+  size_t nhop;
+
+  /* WINDOW_xxx */
+  int window;
+
+  /* stream mode input format, and interleaved channel count */
+#define IFORMAT_TEXT 0
+#define IFORMAT_S16 1
+#define IFORMAT_F32 2
+  int iformat;
+  size_t nchan;
+
+  /* 0 for cpu count */
+  size_t nthread;
+
+  /* fftw planner flags, and wisdom file */
+  unsigned int planner;
+  const char* wisdom;
+
+  /* out of core temporary directory */
+  const char* ooc;
+
+  /* top peaks only, minimum distance in hz, minimum power */
+  size_t npeak;
+  double peak_sep;
+  double peak_min;
+
+  /* peak sub bin interpolation, PEAKS_INTERP_xxx or INTERP_VOCODER */
+  int interp;
+
+  /* transform length policy */
+#define FLEN_EXACT 0
+#define FLEN_PAD 1
+#define FLEN_CROP 2
+  int flen;
+
+  /* zoom band, in hz, and bin count */
+  double fzoom[2];
+  size_t nzoom;
 
 } cmdline_info_t;
 
@@ -173,6 +572,39 @@ static double str_to_double(const char* s)
   return strtod(s, NULL);
 }
 
+static int str_to_tuple(const char* s, double* t, size_t n)
+{
+  size_t i;
+
+  for (i = 0; i != n; ++i)
+  {
+    t[i] = str_to_double(s);
+    for (; *s && (*s != ':'); ++s) ;
+    if (*s == 0) return (i == (n - 1)) ? 0 : -1;
+    ++s;
+  }
+
+  return 0;
+}
+
+static int str_to_icols(const char* s, size_t* icols, size_t* n)
+{
+  /* comma separated column list, ie. 1,2,3 */
+
+  char* p;
+
+  for (*n = 0; *n != CMDLINE_MAX_ICOLS; ++*n)
+  {
+    icols[*n] = (size_t)strtoul(s, &p, 0);
+    if (p == s) return -1;
+    if (*p == 0) { ++*n; return 0; }
+    if (*p != ',') return -1;
+    s = p + 1;
+  }
+
+  return -1;
+}
+
 static int get_cmdline_info(cmdline_info_t* ci, int ac, char** av)
 {
   size_t i;
@@ -186,7 +618,24 @@ static int get_cmdline_info(cmdline_info_t* ci, int ac, char** av)
   ci->tsampl_hi = 0;
   ci->ifile = NULL;
   ci->ofile = NULL;
-  ci->icol = 0;
+  ci->nicol = 0;
+  ci->csv_opts.delims = NULL;
+  ci->oformat = CSV_WRITER_TEXT;
+  ci->nwin = 0;
+  ci->nhop = 0;
+  ci->window = WINDOW_HANN;
+  ci->iformat = IFORMAT_TEXT;
+  ci->nchan = 1;
+  ci->nthread = 0;
+  ci->planner = FFTW_ESTIMATE;
+  ci->wisdom = NULL;
+  ci->ooc = NULL;
+  ci->npeak = 0;
+  ci->peak_sep = 0;
+  ci->peak_min = 0;
+  ci->interp = PEAKS_INTERP_NONE;
+  ci->flen = FLEN_EXACT;
+  ci->nzoom = 0;
 
   for (i = 0; i != ac; i += 2)
   {
@@ -226,7 +675,148 @@ static int get_cmdline_info(cmdline_info_t* ci, int ac, char** av)
     {
       /* input column */
       ci->flags |= CMDLINE_FLAG_ICOL;
-      ci->icol = (size_t)str_to_double(v);
+      if (str_to_icols(v, ci->icols, &ci->nicol)) goto on_error;
+    }
+    else if (strcmp(k, "-delim") == 0)
+    {
+      /* csv field delimiters, ie. "," or $'\t' */
+      ci->flags |= CMDLINE_FLAG_DELIM;
+      ci->csv_opts.delims = v;
+    }
+    else if (strcmp(k, "-oformat") == 0)
+    {
+      /* text or bin, bin being native doubles */
+      ci->flags |= CMDLINE_FLAG_OFORMAT;
+      if (strcmp(v, "text") == 0) ci->oformat = CSV_WRITER_TEXT;
+      else if (strcmp(v, "bin") == 0) ci->oformat = CSV_WRITER_BINARY;
+      else goto on_error;
+    }
+    else if (strcmp(k, "-stft") == 0)
+    {
+      /* nwin:nhop, in samples */
+      double t[2];
+      ci->flags |= CMDLINE_FLAG_STFT;
+      if (str_to_tuple(v, t, 2)) goto on_error;
+      if ((t[0] < 2) || (t[1] < 1)) goto on_error;
+      ci->nwin = (size_t)t[0];
+      ci->nhop = (size_t)t[1];
+    }
+    else if (strcmp(k, "-stream") == 0)
+    {
+      /* nwin:nhop, one row per hop as samples arrive */
+      double t[2];
+      ci->flags |= CMDLINE_FLAG_STREAM;
+      if (str_to_tuple(v, t, 2)) goto on_error;
+      if ((t[0] < 2) || (t[1] < 1)) goto on_error;
+      ci->nwin = (size_t)t[0];
+      ci->nhop = (size_t)t[1];
+    }
+    else if (strcmp(k, "-iformat") == 0)
+    {
+      /* stream samples, raw ones being native endian and interleaved */
+      ci->flags |= CMDLINE_FLAG_IFORMAT;
+      if (strcmp(v, "text") == 0) ci->iformat = IFORMAT_TEXT;
+      else if (strcmp(v, "s16") == 0) ci->iformat = IFORMAT_S16;
+      else if (strcmp(v, "f32") == 0) ci->iformat = IFORMAT_F32;
+      else goto on_error;
+    }
+    else if (strcmp(k, "-nchan") == 0)
+    {
+      /* raw stream channel count, -icol selecting one */
+      ci->flags |= CMDLINE_FLAG_NCHAN;
+      ci->nchan = (size_t)str_to_double(v);
+      if (ci->nchan == 0) goto on_error;
+    }
+    else if (strcmp(k, "-window") == 0)
+    {
+      /* stft window function */
+      ci->flags |= CMDLINE_FLAG_WINDOW;
+      if (strcmp(v, "rect") == 0) ci->window = WINDOW_RECT;
+      else if (strcmp(v, "hann") == 0) ci->window = WINDOW_HANN;
+      else if (strcmp(v, "hamming") == 0) ci->window = WINDOW_HAMMING;
+      else if (strcmp(v, "blackman") == 0) ci->window = WINDOW_BLACKMAN;
+      else goto on_error;
+    }
+    else if (strcmp(k, "-flen") == 0)
+    {
+      /* exact, or pad or crop to a size with small prime factors */
+      ci->flags |= CMDLINE_FLAG_FLEN;
+      if (strcmp(v, "exact") == 0) ci->flen = FLEN_EXACT;
+      else if (strcmp(v, "pad") == 0) ci->flen = FLEN_PAD;
+      else if (strcmp(v, "crop") == 0) ci->flen = FLEN_CROP;
+      else goto on_error;
+    }
+    else if (strcmp(k, "-fzoom") == 0)
+    {
+      /* flo:fhi:nbin, bins include both ends */
+      double t[3];
+      ci->flags |= CMDLINE_FLAG_FZOOM;
+      if (str_to_tuple(v, t, 3)) goto on_error;
+      if ((t[0] < 0) || (t[0] >= t[1]) || (t[2] < 2)) goto on_error;
+      ci->fzoom[0] = t[0];
+      ci->fzoom[1] = t[1];
+      ci->nzoom = (size_t)t[2];
+    }
+    else if (strcmp(k, "-threads") == 0)
+    {
+      /* stft workers and fftw threads, 0 for cpu count */
+      ci->flags |= CMDLINE_FLAG_THREADS;
+      ci->nthread = (size_t)str_to_double(v);
+    }
+    else if (strcmp(k, "-verbose") == 0)
+    {
+      /* planning and transform times on stderr, for bench.sh */
+      if (str_to_double(v) != 0) ci->flags |= CMDLINE_FLAG_VERBOSE;
+    }
+    else if (strcmp(k, "-plan") == 0)
+    {
+      /* fftw planner, measure and patient being worth with -wisdom */
+      ci->flags |= CMDLINE_FLAG_PLAN;
+      if (strcmp(v, "estimate") == 0) ci->planner = FFTW_ESTIMATE;
+      else if (strcmp(v, "measure") == 0) ci->planner = FFTW_MEASURE;
+      else if (strcmp(v, "patient") == 0) ci->planner = FFTW_PATIENT;
+      else goto on_error;
+    }
+    else if (strcmp(k, "-wisdom") == 0)
+    {
+      /* fftw wisdom file, loaded if it exists and saved on exit */
+      ci->flags |= CMDLINE_FLAG_WISDOM;
+      ci->wisdom = v;
+    }
+    else if (strcmp(k, "-peaks") == 0)
+    {
+      /* only output the strongest peaks, by decreasing power */
+      ci->flags |= CMDLINE_FLAG_PEAKS;
+      ci->npeak = (size_t)str_to_double(v);
+    }
+    else if (strcmp(k, "-peak_sep") == 0)
+    {
+      /* minimum distance between peaks, in hz */
+      ci->flags |= CMDLINE_FLAG_PEAK_SEP;
+      ci->peak_sep = str_to_double(v);
+    }
+    else if (strcmp(k, "-peak_min") == 0)
+    {
+      /* minimum normalized peak power */
+      ci->flags |= CMDLINE_FLAG_PEAK_MIN;
+      ci->peak_min = str_to_double(v);
+    }
+    else if (strcmp(k, "-interp") == 0)
+    {
+      /* peak sub bin interpolation, vocoder being stft only */
+      ci->flags |= CMDLINE_FLAG_INTERP;
+      if (strcmp(v, "none") == 0) ci->interp = PEAKS_INTERP_NONE;
+      else if (strcmp(v, "quadratic") == 0) ci->interp = PEAKS_INTERP_QUADRATIC;
+      else if (strcmp(v, "gaussian") == 0) ci->interp = PEAKS_INTERP_GAUSSIAN;
+      else if (strcmp(v, "jacobsen") == 0) ci->interp = PEAKS_INTERP_JACOBSEN;
+      else if (strcmp(v, "vocoder") == 0) ci->interp = INTERP_VOCODER;
+      else goto on_error;
+    }
+    else if (strcmp(k, "-ooc") == 0)
+    {
+      /* out of core transform, temporary files in this directory */
+      ci->flags |= CMDLINE_FLAG_OOC;
+      ci->ooc = v;
     }
     else
     {
@@ -243,117 +833,1254 @@ static int get_cmdline_info(cmdline_info_t* ci, int ac, char** av)
   return -1;
 }
 
-/* main */
+/* fftw threads, for transforms large enough to benefit from them.
+   the threshold is a rough figure, see bench.sh for a given machine.
+ */
 
-int main(int ac, char** av)
+#define FFT_THREADS_MIN_SIZE (1 << 16)
+
+static void fft_threads_init(cmdline_info_t* ci)
+{
+  long ncpu;
+
+  if (ci->nthread == 0)
+  {
+    ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    ci->nthread = (ncpu < 1) ? 1 : (size_t)ncpu;
+  }
+
+  if (ci->nthread > 1) fftw_init_threads();
+}
+
+static size_t fft_threads_plan(const cmdline_info_t* ci, size_t n)
+{
+  /* n the total sample count of the next plan */
+  /* return the thread count the plan uses */
+
+  if (ci->nthread <= 1) return 1;
+
+  if (n < FFT_THREADS_MIN_SIZE)
+  {
+    fftw_plan_with_nthreads(1);
+    return 1;
+  }
+
+  fftw_plan_with_nthreads((int)ci->nthread);
+  return ci->nthread;
+}
+
+static double get_time(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1000000000.0;
+}
+
+
+/* stft mode, one power spectrum row per frame */
+
+static int do_stft(const cmdline_info_t* ci)
 {
+  /* row format: frame start time, then nbin powers */
+
   int err = -1;
-  cmdline_info_t ci;
-  csv_handle_t icsv;
-  double fband;
-  size_t nbin;
-  double* xx;
-  double* ps;
-  double* x;
-  size_t nx;
+  csv_stream_t icsv;
+  csv_writer_t ocsv;
+  pool_t pool;
+  stft_t st;
+  double* win;
+  double* cols;
+  const double* x;
+  size_t nbatch;
+  size_t nline;
+  size_t skip;
+  size_t adv;
+  size_t pos;
+  size_t lo;
+  size_t hi;
   size_t i;
-  size_t n;
+  int n;
 
-  if (get_cmdline_info(&ci, ac - 1, av + 1))
+  if (csv_stream_open(&icsv, ci->ifile, &ci->csv_opts))
   {
     PERROR();
     goto on_error_0;
   }
 
-  if ((ci.flags & CMDLINE_FLAG_IFILE) == 0)
+  if (ci->icols[0] >= icsv.ncol)
   {
     PERROR();
-    goto on_error_0;
+    goto on_error_1;
   }
 
-  if (csv_load_file(&icsv, ci.ifile))
+  cols = malloc(icsv.ncol * STFT_READ_LINES * sizeof(double));
+  if (cols == NULL)
   {
     PERROR();
-    goto on_error_0;
+    goto on_error_1;
   }
 
-  if ((ci.flags & CMDLINE_FLAG_ICOL) == 0)
+  if (pool_create(&pool, ci->nthread))
   {
     PERROR();
-    goto on_error_1;
+    goto on_error_2;
   }
 
-  if (csv_get_col(&icsv, ci.icol, &x, &nx))
+  nbatch = pool.nthread * STFT_TASK_FRAMES;
+
+  st.nwin = ci->nwin;
+  st.nhop = ci->nhop;
+  st.nbin = st.nwin / 2 + 1;
+  st.size = (nbatch - 1) * st.nhop + st.nwin;
+  st.nsig = 0;
+
+  win = malloc(st.nwin * sizeof(double));
+  if (win == NULL)
   {
     PERROR();
-    goto on_error_1;
+    goto on_error_3;
   }
 
-  /* default tsampl_lo tsampl_hi */
+  make_window(win, st.nwin, ci->window);
+  st.win = win;
 
-  if ((ci.flags & CMDLINE_FLAG_FSAMPL) == 0)
+  st.sig = malloc(st.size * sizeof(double));
+  if (st.sig == NULL)
   {
     PERROR();
-    goto on_error_1;
+    goto on_error_4;
   }
 
-  if ((ci.flags & CMDLINE_FLAG_TSAMPL_LO) == 0)
+  st.in = fftw_malloc(nbatch * st.nwin * sizeof(double));
+  if (st.in == NULL)
   {
-    ci.flags |= CMDLINE_FLAG_TSAMPL_LO;
-    ci.tsampl_lo = 0;
+    PERROR();
+    goto on_error_5;
   }
 
-  if ((ci.flags & CMDLINE_FLAG_TSAMPL_HI) == 0)
+  st.out = fftw_malloc(nbatch * st.nbin * sizeof(fftw_complex));
+  if (st.out == NULL)
   {
-    ci.flags |= CMDLINE_FLAG_TSAMPL_HI;
-    ci.tsampl_hi = ci.fsampl * (double)nx;
+    PERROR();
+    goto on_error_6;
   }
 
-  /* recompute sample count */
-
-  i = (size_t)floor(ci.tsampl_lo * ci.fsampl);
-  if (i >= nx)
+  st.ps = malloc(nbatch * st.nbin * sizeof(double));
+  if (st.ps == NULL)
   {
     PERROR();
-    goto on_error_1;
+    goto on_error_7;
   }
 
-  n = (size_t)ceil((ci.tsampl_hi - ci.tsampl_lo) * ci.fsampl);
-  if ((i + n) > nx)
+  /* peaks, vocoder previous frame, found counts and worker scratch
+     in one block */
+
+  st.npeak = ci->npeak;
+  st.sep = (size_t)ceil(ci->peak_sep * (double)st.nwin / ci->fsampl);
+  st.thresh = ci->peak_min;
+  st.ncand = (st.nbin + 1) / 2;
+  st.interp = ci->interp;
+  st.has_prev = 0;
+
+  st.peaks = malloc
+  (
+   nbatch * st.npeak * sizeof(peak_t) +
+   st.nbin * sizeof(fftw_complex) +
+   nbatch * sizeof(size_t) +
+   pool.nthread * st.ncand * sizeof(size_t)
+  );
+  if (st.peaks == NULL)
   {
     PERROR();
-    goto on_error_1;
+    goto on_error_8;
   }
 
-  fband = nsampl_to_fband(n, ci.fsampl);
-
-  nbin = n / 2 + 1;
-
-  ps = malloc(nbin * sizeof(double));
-  if (ps == NULL)
+  st.prev = (fftw_complex*)(st.peaks + nbatch * st.npeak);
+  st.found = (size_t*)(st.prev + st.nbin);
+  st.cand = st.found + nbatch;
+
+  /* planning is not thread safe, tasks only execute. the pool already
+     uses the threads, so that a task plan runs on a single one. */
+  if (ci->nthread > 1) fftw_plan_with_nthreads(1);
+  n = (int)st.nwin;
+  st.plan = fftw_plan_many_dft_r2c
+  (
+   1, &n, STFT_TASK_FRAMES,
+   st.in, NULL, 1, (int)st.nwin,
+   st.out, NULL, 1, (int)st.nbin,
+   ci->planner
+  );
+  if (st.plan == NULL)
   {
     PERROR();
-    goto on_error_1;
+    goto on_error_9;
   }
 
-  xx = malloc(nbin * 2 * sizeof(double));
-  if (xx == NULL)
+  if (csv_writer_open(&ocsv, ci->ofile, ci->oformat))
   {
     PERROR();
-    goto on_error_2;
+    goto on_error_10;
   }
 
-  fft(xx, x + i, n);
-  fft_to_power_spectrum(ps, xx, nbin);
+  /* sample range, up to the end of stream by default */
 
-  for (i = 0; i < nbin; ++i)
+  lo = (size_t)floor(ci->tsampl_lo * ci->fsampl);
+  hi = (size_t)-1;
+  if (ci->flags & CMDLINE_FLAG_TSAMPL_HI)
+    hi = (size_t)ceil(ci->tsampl_hi * ci->fsampl);
+
+  st.lo = lo;
+  st.fsampl = ci->fsampl;
+  st.iframe = 0;
+  skip = 0;
+
+  for (pos = 0; pos < hi; )
+  {
+    if (csv_stream_read(&icsv, cols, STFT_READ_LINES, &nline))
+    {
+      PERROR();
+      goto on_error_11;
+    }
+
+    if (nline == 0) break ;
+
+    x = cols + ci->icols[0] * STFT_READ_LINES;
+
+    for (i = 0; (i != nline) && (pos < hi); ++i, ++pos)
+    {
+      if (pos < lo) continue ;
+
+      /* hop larger than window, samples between frames */
+      if (skip) { --skip; continue ; }
+
+      st.sig[st.nsig++] = x[i];
+      if (st.nsig != st.size) continue ;
+
+      if (stft_flush(&st, &pool, &ocsv))
+      {
+	PERROR();
+	goto on_error_11;
+      }
+
+      /* keep the overlap with the next batch first frame */
+      adv = st.nframe * st.nhop;
+      if (adv < st.nsig)
+      {
+	memmove(st.sig, st.sig + adv, (st.nsig - adv) * sizeof(double));
+	st.nsig -= adv;
+      }
+      else
+      {
+	skip = adv - st.nsig;
+	st.nsig = 0;
+      }
+    }
+  }
+
+  /* last partial batch */
+
+  if (stft_flush(&st, &pool, &ocsv))
+  {
+    PERROR();
+    goto on_error_11;
+  }
+
+  err = 0;
+
+ on_error_11:
+  if (csv_writer_close(&ocsv)) err = -1;
+ on_error_10:
+  fftw_destroy_plan(st.plan);
+ on_error_9:
+  free(st.peaks);
+ on_error_8:
+  free(st.ps);
+ on_error_7:
+  fftw_free(st.out);
+ on_error_6:
+  fftw_free(st.in);
+ on_error_5:
+  free(st.sig);
+ on_error_4:
+  free(win);
+ on_error_3:
+  pool_destroy(&pool);
+ on_error_2:
+  free(cols);
+ on_error_1:
+  csv_stream_close(&icsv);
+ on_error_0:
+  return err;
+}
+
+/* out of core mode, for signals larger than memory */
+
+#define OOC_READ_LINES 4096
+
+static int do_ooc(const cmdline_info_t* ci)
+{
+  /* the length is padded to a power of 2 */
+
+  int err = -1;
+  csv_stream_t icsv;
+  csv_writer_t ocsv;
+  oocfft_t ooc;
+  fftw_complex* xx;
+  double* cols;
+  double* x;
+  double fband;
+  double sum;
+  double p;
+  size_t nline;
+  size_t nbin;
+  size_t pos;
+  size_t lo;
+  size_t hi;
+  size_t i;
+  size_t j;
+  size_t k;
+  size_t n;
+
+  if (csv_stream_open(&icsv, ci->ifile, &ci->csv_opts))
+  {
+    PERROR();
+    goto on_error_0;
+  }
+
+  if (ci->icols[0] >= icsv.ncol)
+  {
+    PERROR();
+    goto on_error_1;
+  }
+
+  cols = malloc(icsv.ncol * OOC_READ_LINES * sizeof(double));
+  if (cols == NULL)
+  {
+    PERROR();
+    goto on_error_1;
+  }
+
+  xx = fftw_malloc(OOC_READ_LINES * sizeof(fftw_complex));
+  if (xx == NULL)
+  {
+    PERROR();
+    goto on_error_2;
+  }
+
+  if (oocfft_open(&ooc, ci->ooc))
+  {
+    PERROR();
+    goto on_error_3;
+  }
+
+  /* append the selected samples to the transform input */
+
+  lo = (size_t)floor(ci->tsampl_lo * ci->fsampl);
+  hi = (size_t)-1;
+  if (ci->flags & CMDLINE_FLAG_TSAMPL_HI)
+    hi = (size_t)ceil(ci->tsampl_hi * ci->fsampl);
+
+  for (pos = 0; pos < hi; pos += nline)
+  {
+    if (csv_stream_read(&icsv, cols, OOC_READ_LINES, &nline))
+    {
+      PERROR();
+      goto on_error_4;
+    }
+
+    if (nline == 0) break ;
+
+    x = cols + ci->icols[0] * OOC_READ_LINES;
+    i = (pos < lo) ? (lo - pos) : 0;
+    n = ((pos + nline) > hi) ? (hi - pos) : nline;
+    if (i >= n) continue ;
+
+    if (oocfft_write(&ooc, x + i, n - i))
+    {
+      PERROR();
+      goto on_error_4;
+    }
+  }
+
+  if (ooc.count == 0)
+  {
+    PERROR();
+    goto on_error_4;
+  }
+
+  fft_threads_plan(ci, OOCFFT_BLOCK_SIZE / sizeof(fftw_complex));
+
+  if (oocfft_exec(&ooc, ci->planner))
+  {
+    PERROR();
+    goto on_error_4;
+  }
+
+  nbin = ooc.n / 2 + 1;
+  fband = nsampl_to_fband(ooc.n, ci->fsampl);
+
+  fprintf
+  (
+   stderr, "fft length %zu (%zu samples), bin spacing %g hz, out of core\n",
+   ooc.n, ooc.count, fband
+  );
+
+  /* normalization sum, then output. bins are read back twice. */
+
+  sum = 0;
+  for (i = 0; i < nbin; i += k)
+  {
+    k = ((nbin - i) < OOC_READ_LINES) ? (nbin - i) : OOC_READ_LINES;
+    oocfft_read(&ooc, xx, i, k);
+    for (j = 0; j != k; ++j)
+      sum += sqrt(xx[j][0] * xx[j][0] + xx[j][1] * xx[j][1]);
+  }
+
+  if (sum <= 0.00001) sum = 1;
+
+  if (csv_writer_open(&ocsv, ci->ofile, ci->oformat))
+  {
+    PERROR();
+    goto on_error_4;
+  }
+
+  for (i = 0; i < nbin; i += k)
+  {
+    k = ((nbin - i) < OOC_READ_LINES) ? (nbin - i) : OOC_READ_LINES;
+    oocfft_read(&ooc, xx, i, k);
+    for (j = 0; j != k; ++j)
+    {
+      p = sqrt(xx[j][0] * xx[j][0] + xx[j][1] * xx[j][1]);
+      csv_writer_put(&ocsv, bin_to_freq(i + j, fband));
+      csv_writer_put(&ocsv, p / sum);
+      csv_writer_endl(&ocsv);
+    }
+  }
+
+  if (csv_writer_close(&ocsv))
+  {
+    PERROR();
+    goto on_error_4;
+  }
+
+  err = 0;
+
+ on_error_4:
+  oocfft_close(&ooc);
+ on_error_3:
+  fftw_free(xx);
+ on_error_2:
+  free(cols);
+ on_error_1:
+  csv_stream_close(&icsv);
+ on_error_0:
+  return err;
+}
+
+/* stream mode. samples are read from a pipe as they arrive and a
+   spectrum row is written and flushed every hop, so that memory and
+   latency only depend on the window. unlike stft, frames are not
+   batched: it is meant for live sources, ie. tonegen or a capture.
+ */
+
+#define STREAM_READ_FRAMES 1024
+
+typedef struct stream
+{
+  const cmdline_info_t* ci;
+
+  size_t nwin;
+  size_t nhop;
+  size_t nbin;
+  const double* win;
+
+  /* rolling window, samples to skip when the hop exceeds it */
+  double* sig;
+  size_t nsig;
+  size_t skip;
+  size_t iframe;
+
+  double* in;
+  fftw_complex* out;
+  fftw_complex* prev;
+  double* ps;
+  peak_t* peaks;
+  size_t* cand;
+  fftw_plan plan;
+
+  csv_writer_t* w;
+
+} stream_t;
+
+static int stream_frame(stream_t* st)
+{
+  /* transform the window and output its row */
+
+  const cmdline_info_t* const ci = st->ci;
+  const double fband = ci->fsampl / (double)st->nwin;
+  csv_writer_t* const w = st->w;
+  size_t found;
+  size_t i;
+
+  for (i = 0; i != st->nwin; ++i) st->in[i] = st->sig[i] * st->win[i];
+  fftw_execute(st->plan);
+  fft_to_power_spectrum(st->ps, (const double*)st->out, st->nbin);
+
+  csv_writer_put(w, (double)(st->iframe * st->nhop) / ci->fsampl);
+
+  if (ci->npeak)
+  {
+    found = ci->npeak;
+    peaks_find
+    (
+     st->peaks, &found, st->ps, st->nbin,
+     (size_t)ceil(ci->peak_sep / fband), ci->peak_min, st->cand
+    );
+
+    peaks_interp
+    (
+     st->peaks, found, st->ps, (const double*)st->out, st->nbin,
+     (ci->interp == INTERP_VOCODER) ? PEAKS_INTERP_QUADRATIC : ci->interp
+    );
+
+    if (ci->interp == INTERP_VOCODER)
+    {
+      if (st->iframe)
+      {
+	vocoder_interp
+	(st->peaks, found, st->prev, st->out, st->nwin, st->nhop);
+      }
+
+      memcpy(st->prev, st->out, st->nbin * sizeof(fftw_complex));
+    }
+
+    put_peaks(w, st->peaks, found, ci->npeak, 0.0, fband);
+  }
+  else
+  {
+    for (i = 0; i != st->nbin; ++i) csv_writer_put(w, st->ps[i]);
+  }
+
+  csv_writer_endl(w);
+  ++st->iframe;
+
+  /* the row is not held until the buffer fills up */
+  return csv_writer_flush(w);
+}
+
+static int stream_push(stream_t* st, double x)
+{
+  /* add a sample, output a row when the window completes */
+
+  size_t adv;
+
+  if (st->skip) { --st->skip; return 0; }
+
+  st->sig[st->nsig++] = x;
+  if (st->nsig != st->nwin) return 0;
+
+  if (stream_frame(st)) return -1;
+
+  adv = st->nhop;
+  if (adv < st->nsig)
+  {
+    memmove(st->sig, st->sig + adv, (st->nsig - adv) * sizeof(double));
+    st->nsig -= adv;
+  }
+  else
+  {
+    st->skip = adv - st->nsig;
+    st->nsig = 0;
+  }
+
+  return 0;
+}
+
+static int stream_raw(stream_t* st, int fd)
+{
+  /* fixed size blocks of interleaved frames, a read possibly ending
+     in the middle of one */
+
+  const cmdline_info_t* const ci = st->ci;
+  const size_t ssize = (ci->iformat == IFORMAT_S16) ? 2 : 4;
+  const size_t fsize = ci->nchan * ssize;
+  const size_t size = STREAM_READ_FRAMES * fsize;
+  unsigned char* buf;
+  const unsigned char* p;
+  size_t len;
+  size_t nframe;
+  size_t i;
+  ssize_t n;
+  int16_t s16;
+  float f32;
+  int err = -1;
+
+  buf = malloc(size);
+  if (buf == NULL)
+  {
+    PERROR();
+    goto on_error_0;
+  }
+
+  len = 0;
+
+  while (1)
+  {
+    n = read(fd, buf + len, size - len);
+    if (n < 0)
+    {
+      if (errno == EINTR) continue ;
+      PERROR();
+      goto on_error_1;
+    }
+
+    /* trailing partial frame ignored */
+    if (n == 0) break ;
+
+    len += (size_t)n;
+    nframe = len / fsize;
+
+    for (i = 0; i != nframe; ++i)
+    {
+      p = buf + i * fsize + ci->icols[0] * ssize;
+
+      if (ci->iformat == IFORMAT_S16)
+      {
+	memcpy(&s16, p, sizeof(s16));
+	if (stream_push(st, (double)s16)) goto on_error_1;
+      }
+      else
+      {
+	memcpy(&f32, p, sizeof(f32));
+	if (stream_push(st, (double)f32)) goto on_error_1;
+      }
+    }
+
+    len -= nframe * fsize;
+    memmove(buf, buf + nframe * fsize, len);
+  }
+
+  err = 0;
+
+ on_error_1:
+  free(buf);
+ on_error_0:
+  return err;
+}
+
+static int stream_text(stream_t* st, const char* path)
+{
+  /* one line at a time, not to wait for a block */
+
+  const cmdline_info_t* const ci = st->ci;
+  csv_stream_t icsv;
+  double* cols;
+  size_t nline;
+  int err = -1;
+
+  if (csv_stream_open(&icsv, path, &ci->csv_opts))
+  {
+    PERROR();
+    goto on_error_0;
+  }
+
+  if (ci->icols[0] >= icsv.ncol)
+  {
+    PERROR();
+    goto on_error_1;
+  }
+
+  cols = malloc(icsv.ncol * sizeof(double));
+  if (cols == NULL)
+  {
+    PERROR();
+    goto on_error_1;
+  }
+
+  while (1)
+  {
+    if (csv_stream_read(&icsv, cols, 1, &nline))
+    {
+      PERROR();
+      goto on_error_2;
+    }
+
+    if (nline == 0) break ;
+
+    if (stream_push(st, cols[ci->icols[0]])) goto on_error_2;
+  }
+
+  err = 0;
+
+ on_error_2:
+  free(cols);
+ on_error_1:
+  csv_stream_close(&icsv);
+ on_error_0:
+  return err;
+}
+
+static int do_stream(const cmdline_info_t* ci)
+{
+  /* ifile defaults to stdin, icol is the channel of raw formats */
+
+  int err = -1;
+  csv_writer_t ocsv;
+  stream_t st;
+  double* win;
+  int fd;
+
+  st.ci = ci;
+  st.nwin = ci->nwin;
+  st.nhop = ci->nhop;
+  st.nbin = st.nwin / 2 + 1;
+  st.nsig = 0;
+  st.skip = 0;
+  st.iframe = 0;
+  st.w = &ocsv;
+
+  if ((ci->iformat != IFORMAT_TEXT) && (ci->icols[0] >= ci->nchan))
+  {
+    PERROR();
+    goto on_error_0;
+  }
+
+  /* window, signal, power and previous frame in one block */
+
+  win = malloc
+  (
+   (2 * st.nwin + st.nbin) * sizeof(double) +
+   st.nbin * sizeof(fftw_complex) +
+   ci->npeak * sizeof(peak_t) +
+   (st.nbin + 1) / 2 * sizeof(size_t)
+  );
+  if (win == NULL)
+  {
+    PERROR();
+    goto on_error_0;
+  }
+
+  make_window(win, st.nwin, ci->window);
+  st.win = win;
+  st.sig = win + st.nwin;
+  st.ps = st.sig + st.nwin;
+  st.prev = (fftw_complex*)(st.ps + st.nbin);
+  st.peaks = (peak_t*)(st.prev + st.nbin);
+  st.cand = (size_t*)(st.peaks + ci->npeak);
+
+  st.in = fftw_malloc(st.nwin * sizeof(double));
+  if (st.in == NULL)
+  {
+    PERROR();
+    goto on_error_1;
+  }
+
+  st.out = fftw_malloc(st.nbin * sizeof(fftw_complex));
+  if (st.out == NULL)
+  {
+    PERROR();
+    goto on_error_2;
+  }
+
+  fft_threads_plan(ci, st.nwin);
+  st.plan = fftw_plan_dft_r2c_1d((int)st.nwin, st.in, st.out, ci->planner);
+  if (st.plan == NULL)
   {
-    printf("%lf %lf\n", bin_to_freq(i, fband), ps[i]);
+    PERROR();
+    goto on_error_3;
+  }
+
+  if (csv_writer_open(&ocsv, ci->ofile, ci->oformat))
+  {
+    PERROR();
+    goto on_error_4;
+  }
+
+  if (ci->iformat == IFORMAT_TEXT)
+  {
+    err = stream_text(&st, ci->ifile);
+  }
+  else
+  {
+    fd = 0;
+    if ((ci->ifile != NULL) && strcmp(ci->ifile, "-"))
+    {
+      fd = open(ci->ifile, O_RDONLY);
+      if (fd == -1)
+      {
+	PERROR();
+	goto on_error_5;
+      }
+    }
+
+    err = stream_raw(&st, fd);
+    if (fd) close(fd);
+  }
+
+ on_error_5:
+  if (csv_writer_close(&ocsv)) err = -1;
+ on_error_4:
+  fftw_destroy_plan(st.plan);
+ on_error_3:
+  fftw_free(st.out);
+ on_error_2:
+  fftw_free(st.in);
+ on_error_1:
+  free(win);
+ on_error_0:
+  return err;
+}
+
+
+/* main */
+
+int main(int ac, char** av)
+{
+  int err = -1;
+  cmdline_info_t ci;
+  csv_handle_t icsv;
+  csv_writer_t ocsv;
+  double fband;
+  double flo;
+  peak_t* peaks;
+  size_t* found;
+  size_t nbin;
+  fftw_complex* xx;
+  double* ps;
+  double* sig;
+  double* buf;
+  double* x;
+  double* y;
+  size_t idist;
+  size_t nfft;
+  fftw_plan plan;
+  int is_czt;
+  int is_fftw;
+  size_t nthread;
+  double t0;
+  double t1;
+  double t2;
+  double t3;
+  size_t nx;
+  size_t i;
+  size_t j;
+  size_t n;
+
+  if (get_cmdline_info(&ci, ac - 1, av + 1))
+  {
+    PERROR();
+    goto on_error_0;
+  }
+
+  /* stream mode reads stdin and the first column by default */
+
+  if (ci.flags & CMDLINE_FLAG_STREAM)
+  {
+    if ((ci.flags & CMDLINE_FLAG_ICOL) == 0)
+    {
+      ci.flags |= CMDLINE_FLAG_ICOL;
+      ci.icols[0] = 0;
+      ci.nicol = 1;
+    }
+  }
+
+  if ((ci.flags & (CMDLINE_FLAG_IFILE | CMDLINE_FLAG_STREAM)) == 0)
+  {
+    PERROR();
+    goto on_error_0;
+  }
+
+  if ((ci.flags & CMDLINE_FLAG_ICOL) == 0)
+  {
+    PERROR();
+    goto on_error_0;
+  }
+
+  if ((ci.flags & CMDLINE_FLAG_FSAMPL) == 0)
+  {
+    PERROR();
+    goto on_error_0;
+  }
+
+  /* default tsampl_lo */
+
+  if ((ci.flags & CMDLINE_FLAG_TSAMPL_LO) == 0)
+  {
+    ci.flags |= CMDLINE_FLAG_TSAMPL_LO;
+    ci.tsampl_lo = 0;
+  }
+
+  /* wisdom is keyed by the thread count, init threads first */
+
+  fft_threads_init(&ci);
+
+  if (ci.wisdom != NULL) fftw_import_wisdom_from_filename(ci.wisdom);
+
+  /* the vocoder needs consecutive frames */
+  if (ci.interp == INTERP_VOCODER)
+  {
+    if ((ci.flags & (CMDLINE_FLAG_STFT | CMDLINE_FLAG_STREAM)) == 0)
+    {
+      PERROR();
+      goto on_error_0;
+    }
+  }
+
+  if (ci.flags & CMDLINE_FLAG_STREAM)
+  {
+    /* single column */
+    if (ci.nicol != 1)
+    {
+      PERROR();
+      goto on_error_0;
+    }
+
+    err = do_stream(&ci);
+    if ((err == 0) && (ci.wisdom != NULL))
+      fftw_export_wisdom_to_filename(ci.wisdom);
+    goto on_error_0;
+  }
+
+  if (ci.flags & CMDLINE_FLAG_STFT)
+  {
+    /* single column */
+    if (ci.nicol != 1)
+    {
+      PERROR();
+      goto on_error_0;
+    }
+
+    err = do_stft(&ci);
+    if ((err == 0) && (ci.wisdom != NULL))
+      fftw_export_wisdom_to_filename(ci.wisdom);
+    goto on_error_0;
+  }
+
+  if (ci.flags & CMDLINE_FLAG_OOC)
+  {
+    /* single column */
+    if (ci.nicol != 1)
+    {
+      PERROR();
+      goto on_error_0;
+    }
+
+    err = do_ooc(&ci);
+    if ((err == 0) && (ci.wisdom != NULL))
+      fftw_export_wisdom_to_filename(ci.wisdom);
+    goto on_error_0;
+  }
+
+  /* compute sample range */
+
+  i = (size_t)floor(ci.tsampl_lo * ci.fsampl);
+  n = 0;
+
+  if (ci.flags & CMDLINE_FLAG_TSAMPL_HI)
+  {
+    /* only load the selected lines, using the line index */
+    n = (size_t)ceil((ci.tsampl_hi - ci.tsampl_lo) * ci.fsampl);
+    if (csv_load_lines(&icsv, ci.ifile, &ci.csv_opts, i, n))
+    {
+      PERROR();
+      goto on_error_0;
+    }
+    i = 0;
+  }
+  else if (csv_load_file(&icsv, ci.ifile, &ci.csv_opts))
+  {
+    PERROR();
+    goto on_error_0;
+  }
+
+  if (csv_get_col(&icsv, ci.icols[0], &x, &nx))
+  {
+    PERROR();
+    goto on_error_1;
+  }
+
+  /* columns are contiguous, with nx samples. a list with a constant
+     step is transformed in place, with a stride of step columns. */
+
+  idist = nx;
+  for (j = 1; j != ci.nicol; ++j)
+  {
+    if (csv_get_col(&icsv, ci.icols[j], &y, &nx))
+    {
+      PERROR();
+      goto on_error_1;
+    }
+
+    if (y <= x) idist = 0;
+    else if (j == 1) idist = (size_t)(y - x);
+    else if ((size_t)(y - x) != (j * idist)) idist = 0;
+  }
+
+  if ((ci.nicol * idist) > INT_MAX) idist = 0;
+
+  if (i >= nx)
+  {
+    PERROR();
+    goto on_error_1;
+  }
+
+  /* default tsampl_hi, up to the last sample */
+
+  if ((ci.flags & CMDLINE_FLAG_TSAMPL_HI) == 0)
+  {
+    ci.flags |= CMDLINE_FLAG_TSAMPL_HI;
+    ci.tsampl_hi = (double)nx / ci.fsampl;
+    n = nx - i;
+  }
+
+  if ((i + n) > nx)
+  {
+    PERROR();
+    goto on_error_1;
+  }
+
+  /* transform length. exact lengths with a large prime factor use
+     the chirp z transform, padded lengths are zero filled. */
+
+  nfft = n;
+  if (ci.flen == FLEN_PAD) nfft = czt_next_size(n);
+  else if (ci.flen == FLEN_CROP) nfft = czt_prev_size(n);
+
+  is_czt = (czt_max_factor(nfft) > CZT_SLOW_FACTOR);
+
+  fband = nsampl_to_fband(nfft, ci.fsampl);
+  nbin = nfft / 2 + 1;
+  flo = 0;
+
+  if (ci.flags & CMDLINE_FLAG_FZOOM)
+  {
+    /* only the zoom bins, using the chirp z transform over n samples.
+       the resolution does not depend on n, but two tones closer than
+       fsampl / n still cannot be separated. powers are normalized
+       over the zoom bins only. */
+
+    nfft = n;
+    nbin = ci.nzoom;
+    flo = ci.fzoom[0];
+    fband = (ci.fzoom[1] - ci.fzoom[0]) / (double)(nbin - 1);
+
+    fprintf
+    (
+     stderr, "zoom %g to %g hz, %zu bins, bin spacing %g hz\n",
+     ci.fzoom[0], ci.fzoom[1], nbin, fband
+    );
+  }
+  else
+  {
+    fprintf
+    (
+     stderr, "fft length %zu (%zu samples), bin spacing %g hz%s\n",
+     nfft, n, fband, is_czt ? ", chirp z" : ""
+    );
+  }
+
+  /* cropped, the remaining samples are ignored */
+  if (nfft < n) n = nfft;
+
+  ps = malloc(ci.nicol * nbin * sizeof(double));
+  if (ps == NULL)
+  {
+    PERROR();
+    goto on_error_1;
+  }
+
+  xx = fftw_malloc(ci.nicol * nbin * sizeof(fftw_complex));
+  if (xx == NULL)
+  {
+    PERROR();
+    goto on_error_2;
+  }
+
+  sig = x + i;
+  buf = NULL;
+  plan = NULL;
+
+  /* planners other than estimate overwrite the input, so that they
+     plan on the gather buffer before it is filled */
+
+  if ((idist == 0) || (nfft > n) || (ci.planner != FFTW_ESTIMATE))
+  {
+    idist = nfft;
+
+    buf = fftw_malloc(ci.nicol * nfft * sizeof(double));
+    if (buf == NULL)
+    {
+      PERROR();
+      goto on_error_3;
+    }
+
+    sig = buf;
+  }
+
+  is_fftw = ((ci.flags & CMDLINE_FLAG_FZOOM) == 0) && (is_czt == 0);
+  nthread = 1;
+
+  t0 = get_time();
+
+  if (is_fftw)
+  {
+    nthread = fft_threads_plan(&ci, ci.nicol * nfft);
+
+    plan = fft_plan(xx, sig, nfft, ci.nicol, idist, ci.planner);
+    if (plan == NULL)
+    {
+      PERROR();
+      goto on_error_4;
+    }
+  }
+
+  t1 = get_time();
+
+  if (buf != NULL)
+  {
+    /* gather the selected ranges */
+
+    for (j = 0; j != ci.nicol; ++j)
+    {
+      csv_get_col(&icsv, ci.icols[j], &y, &nx);
+      memcpy(sig + j * nfft, y + i, n * sizeof(double));
+      memset(sig + j * nfft + n, 0, (nfft - n) * sizeof(double));
+    }
+  }
+
+  t2 = get_time();
+
+  if (ci.flags & CMDLINE_FLAG_FZOOM)
+  {
+    const double w0 = 2.0 * M_PI * flo / ci.fsampl;
+    const double dw = 2.0 * M_PI * fband / ci.fsampl;
+
+    if (czt_band(xx, sig, n, ci.nicol, idist, nbin, w0, dw))
+    {
+      PERROR();
+      goto on_error_5;
+    }
+  }
+  else if (is_czt)
+  {
+    if (czt_many(xx, sig, nfft, ci.nicol, idist))
+    {
+      PERROR();
+      goto on_error_5;
+    }
+  }
+  else
+  {
+    fftw_execute(plan);
+  }
+
+  t3 = get_time();
+
+  if (ci.flags & CMDLINE_FLAG_VERBOSE)
+  {
+    fprintf
+    (
+     stderr, "plan %g s, transform %g s, %zu threads\n",
+     t1 - t0, t3 - t2, nthread
+    );
+  }
+
+  for (j = 0; j != ci.nicol; ++j)
+  {
+    double* const p = (double*)(xx + j * nbin);
+    fft_to_power_spectrum(ps + j * nbin, p, nbin);
+  }
+
+  /* top peaks of each column */
+
+  peaks = NULL;
+  found = NULL;
+
+  if (ci.npeak)
+  {
+    peaks = malloc(ci.nicol * (ci.npeak * sizeof(peak_t) + sizeof(size_t)));
+    if (peaks == NULL)
+    {
+      PERROR();
+      goto on_error_5;
+    }
+
+    found = (size_t*)(peaks + ci.nicol * ci.npeak);
+
+    for (j = 0; j != ci.nicol; ++j)
+    {
+      found[j] = ci.npeak;
+      if (peaks_find
+	  (
+	   peaks + j * ci.npeak, found + j, ps + j * nbin, nbin,
+	   (size_t)ceil(ci.peak_sep / fband), ci.peak_min, NULL
+	  ))
+      {
+	PERROR();
+	goto on_error_6;
+      }
+
+      /* jacobsen uses the complex bins */
+      peaks_interp
+      (
+       peaks + j * ci.npeak, found[j], ps + j * nbin,
+       (const double*)(xx + j * nbin), nbin, ci.interp
+      );
+    }
+  }
+
+  /* ofile defaults to stdout */
+
+  if (csv_writer_open(&ocsv, ci.ofile, ci.oformat))
+  {
+    PERROR();
+    goto on_error_6;
+  }
+
+  if (ci.npeak)
+  {
+    /* one peak per row, a frequency and power pair per input column */
+
+    for (i = 0; i != ci.npeak; ++i)
+    {
+      for (j = 0; j != ci.nicol; ++j)
+      {
+	const size_t n = (found[j] > i) ? 1 : 0;
+	put_peaks(&ocsv, peaks + j * ci.npeak + i, n, 1, flo, fband);
+      }
+      csv_writer_endl(&ocsv);
+    }
+  }
+  else
+  {
+    /* frequency, then one power column per input column */
+
+    for (i = 0; i < nbin; ++i)
+    {
+      csv_writer_put(&ocsv, flo + bin_to_freq(i, fband));
+      for (j = 0; j != ci.nicol; ++j) csv_writer_put(&ocsv, ps[j * nbin + i]);
+      csv_writer_endl(&ocsv);
+    }
+  }
+
+  if (csv_writer_close(&ocsv))
+  {
+    PERROR();
+    goto on_error_6;
   }
 
   err = 0;
 
-  free(xx);
+  if (ci.wisdom != NULL) fftw_export_wisdom_to_filename(ci.wisdom);
+
+ on_error_6:
+  if (peaks != NULL) free(peaks);
+ on_error_5:
+  if (plan != NULL) fftw_destroy_plan(plan);
+ on_error_4:
+  if (buf != NULL) fftw_free(buf);
+ on_error_3:
+  fftw_free(xx);
  on_error_2:
   free(ps);
  on_error_1:
@@ -1,3 +1,4 @@
 #!/usr/bin/env sh
 
-gcc -DCONFIG_PERROR -O2 -Wall filter.c ../common/csv.c -lm -lfftw3
+gcc -DCONFIG_PERROR -O2 -Wall -DCSV_CONFIG_ZLIB -DCSV_CONFIG_ZSTD -I../../biquad \
+filter.c ../common/csv.c ../common/dtoa.c ../common/czt.c ../common/pool.c ../../biquad/biquad.c -lm -lfftw3 -lz -lzstd -lpthread
@@ -3,8 +3,12 @@
 #include <stdint.h>
 #include <string.h>
 #include <math.h>
+#include <unistd.h>
 #include <fftw3.h>
 #include "../common/csv.h"
+#include "../common/czt.h"
+#include "../common/pool.h"
+#include "biquad.h"
 
 
 #ifdef CONFIG_PERROR
@@ -68,40 +72,184 @@ static inline void bins_to_freqs
 }
 
 
-/* filter using fft */
+/* filter using fft. each worker owns its plans and buffers, so
+   that columns are filtered in parallel. plans are created by the
+   main thread, fftw planning not being thread safe. */
+
+typedef struct filter_worker
+{
+  int is_czt;
+
+  /* fftw, real input and output, half spectrum */
+  double* in;
+  double* out;
+  fftw_complex* spec;
+  fftw_plan fwd;
+  fftw_plan bwd;
+
+  /* chirp z, for lengths fftw is slow with */
+  czt_t czt;
+  fftw_complex* a;
+  fftw_complex* b;
+
+} filter_worker_t;
+
+static int filter_worker_init(filter_worker_t* fw, size_t nfft, int is_czt)
+{
+  fw->is_czt = is_czt;
+
+  if (is_czt)
+  {
+    fw->a = fftw_malloc(2 * nfft * sizeof(fftw_complex));
+    if (fw->a == NULL) goto on_error_0;
+    fw->b = fw->a + nfft;
+
+    if (czt_init(&fw->czt, nfft, nfft, 0.0, 2.0 * M_PI / (double)nfft))
+    {
+      fftw_free(fw->a);
+      goto on_error_0;
+    }
+
+    return 0;
+  }
+
+  fw->in = fftw_malloc(2 * nfft * sizeof(double));
+  if (fw->in == NULL) goto on_error_0;
+  fw->out = fw->in + nfft;
+
+  fw->spec = fftw_malloc((nfft / 2 + 1) * sizeof(fftw_complex));
+  if (fw->spec == NULL) goto on_error_1;
+
+  fw->fwd = fftw_plan_dft_r2c_1d((int)nfft, fw->in, fw->spec, FFTW_ESTIMATE);
+  if (fw->fwd == NULL) goto on_error_2;
+
+  fw->bwd = fftw_plan_dft_c2r_1d((int)nfft, fw->spec, fw->out, FFTW_ESTIMATE);
+  if (fw->bwd == NULL) goto on_error_3;
+
+  return 0;
+
+ on_error_3:
+  fftw_destroy_plan(fw->fwd);
+ on_error_2:
+  fftw_free(fw->spec);
+ on_error_1:
+  fftw_free(fw->in);
+ on_error_0:
+  return -1;
+}
+
+static void filter_worker_fini(filter_worker_t* fw)
+{
+  if (fw->is_czt)
+  {
+    czt_fini(&fw->czt);
+    fftw_free(fw->a);
+    return ;
+  }
+
+  fftw_destroy_plan(fw->bwd);
+  fftw_destroy_plan(fw->fwd);
+  fftw_free(fw->spec);
+  fftw_free(fw->in);
+}
 
 static void filter
-(double* xx, const double* x, unsigned int n, const double* coeffs)
+(
+ filter_worker_t* fw, double* xx, const double* x, size_t n,
+ size_t nfft, const double* coeffs
+)
 {
-  /* n the size of the transform */
+  /* n the signal length, zero padded to the transform size nfft */
 
-  fftw_plan plan;
-  fftw_complex* out;
-  unsigned int i;
+  size_t i;
 
-  out = fftw_malloc((n / 2 + 1) * sizeof(fftw_complex));
+  memcpy(fw->in, x, n * sizeof(double));
+  memset(fw->in + n, 0, (nfft - n) * sizeof(double));
 
   /* forward transform */
 
-  plan = fftw_plan_dft_r2c_1d(n, (double*)x, out, FFTW_ESTIMATE);
-  fftw_execute(plan);
-  fftw_destroy_plan(plan);
+  fftw_execute(fw->fwd);
 
   /* filter */
 
-  for (i = 0; i != n / 2 + 1; ++i)
+  for (i = 0; i != nfft / 2 + 1; ++i)
   {
-    out[i][0] *= coeffs[i];
-    out[i][1] *= coeffs[i];
+    fw->spec[i][0] *= coeffs[i];
+    fw->spec[i][1] *= coeffs[i];
   }
 
   /* normalized inverse transform */
 
-  plan = fftw_plan_dft_c2r_1d(n, out, (double*)xx, FFTW_ESTIMATE);
-  fftw_execute(plan);
-  for (i = 0; i != n; ++i) xx[i] /= (double)n;
-  fftw_destroy_plan(plan);
-  fftw_free(out);
+  fftw_execute(fw->bwd);
+  for (i = 0; i != n; ++i) xx[i] = fw->out[i] / (double)nfft;
+}
+
+static void filter_czt
+(
+ filter_worker_t* fw, double* xx, const double* x, size_t n,
+ size_t nfft, const double* coeffs
+)
+{
+  /* same as filter, for lengths fftw is slow with. the inverse uses
+     idft(z) = conj(dft(conj(z))) / n, so one full length czt is enough.
+   */
+
+  fftw_complex* const a = fw->a;
+  fftw_complex* const b = fw->b;
+  double c;
+  size_t i;
+
+  /* forward transform */
+
+  for (i = 0; i != nfft; ++i)
+  {
+    a[i][0] = (i < n) ? x[i] : 0;
+    a[i][1] = 0;
+  }
+
+  czt_exec(&fw->czt, a, b);
+
+  /* filter, coeffs are symmetric around n / 2, and conjugate */
+
+  for (i = 0; i != nfft; ++i)
+  {
+    c = coeffs[(i <= (nfft / 2)) ? i : (nfft - i)];
+    a[i][0] = b[i][0] * c;
+    a[i][1] = -b[i][1] * c;
+  }
+
+  /* normalized inverse transform, real part */
+
+  czt_exec(&fw->czt, a, b);
+  for (i = 0; i != n; ++i) xx[i] = b[i][0] / (double)nfft;
+}
+
+
+/* one pool task per column */
+
+typedef struct filter_job
+{
+  filter_worker_t* workers;
+  const double* coeffs;
+
+  /* column j input at x[j], output at xx + j * n */
+  const double** x;
+  double* xx;
+  size_t n;
+  size_t nfft;
+
+} filter_job_t;
+
+static void filter_task(void* arg, size_t task, size_t worker)
+{
+  filter_job_t* const job = arg;
+  filter_worker_t* const fw = job->workers + worker;
+  double* const xx = job->xx + task * job->n;
+
+  if (fw->is_czt)
+    filter_czt(fw, xx, job->x[task], job->n, job->nfft, job->coeffs);
+  else
+    filter(fw, xx, job->x[task], job->n, job->nfft, job->coeffs);
 }
 
 
@@ -135,6 +283,105 @@ typedef struct node
   struct node* next;
 } node_t;
 
+
+/* filtering coeffs of nbin bins fband apart, from the filter list */
+
+static int make_coeffs
+(double* coeffs, size_t nbin, double fband, const node_t* filters)
+{
+  const node_t* pos;
+  size_t j;
+  size_t k;
+
+  for (j = 0; j != nbin; ++j) coeffs[j] = 1.0;
+
+  for (pos = filters; pos; pos = pos->next)
+  {
+    if (pos->triple[0] < 0) return -1;
+    if (pos->triple[1] > ((double)nbin * fband)) return -1;
+    if (pos->triple[0] > pos->triple[1]) return -1;
+
+    j = floor(pos->triple[0] / fband);
+    k = ceil(pos->triple[1] / fband);
+    if (k > nbin) k = nbin;
+    for (; j != k; ++j) coeffs[j] = pos->triple[2];
+  }
+
+  return 0;
+}
+
+
+/* finite kernel design by frequency sampling. the coeffs are sampled
+   on a grid much denser than the kernel, the zero phase response is
+   centered, truncated to ntap and blackman windowed. ntap is odd, the
+   kernel delay being (ntap - 1) / 2 samples.
+ */
+
+#define KERNEL_GRID_FACTOR 8
+
+static int make_kernel
+(double* h, size_t ntap, double fsampl, const node_t* filters)
+{
+  const size_t d = (ntap - 1) / 2;
+  fftw_plan plan;
+  fftw_complex* hh;
+  double* g;
+  double* coeffs;
+  double a;
+  size_t ngrid;
+  size_t nbin;
+  size_t i;
+  int err = -1;
+
+  for (ngrid = 1; ngrid < (KERNEL_GRID_FACTOR * ntap); ngrid *= 2) ;
+  nbin = ngrid / 2 + 1;
+
+  coeffs = malloc(nbin * sizeof(double));
+  if (coeffs == NULL) goto on_error_0;
+
+  if (make_coeffs(coeffs, nbin, fsampl / (double)ngrid, filters))
+    goto on_error_1;
+
+  hh = fftw_malloc(nbin * sizeof(fftw_complex));
+  if (hh == NULL) goto on_error_1;
+
+  g = fftw_malloc(ngrid * sizeof(double));
+  if (g == NULL) goto on_error_2;
+
+  for (i = 0; i != nbin; ++i)
+  {
+    hh[i][0] = coeffs[i];
+    hh[i][1] = 0;
+  }
+
+  plan = fftw_plan_dft_c2r_1d((int)ngrid, hh, g, FFTW_ESTIMATE);
+  if (plan == NULL) goto on_error_3;
+  fftw_execute(plan);
+  fftw_destroy_plan(plan);
+
+  /* center, window and normalize */
+
+  a = 2.0 * M_PI / (double)(ntap - 1);
+
+  for (i = 0; i != ntap; ++i)
+  {
+    const double w =
+      0.42 - 0.5 * cos(a * (double)i) + 0.08 * cos(2.0 * a * (double)i);
+    h[i] = w * g[(i + ngrid - d) % ngrid] / (double)ngrid;
+  }
+
+  err = 0;
+
+ on_error_3:
+  fftw_free(g);
+ on_error_2:
+  fftw_free(hh);
+ on_error_1:
+  free(coeffs);
+ on_error_0:
+  return err;
+}
+
 typedef struct
 {
 #define CMDLINE_FLAG_FSAMPL (1 << 0)
@@ -142,6 +389,13 @@ typedef struct
 #define CMDLINE_FLAG_IFILE (1 << 2)
 #define CMDLINE_FLAG_OFILE (1 << 3)
 #define CMDLINE_FLAG_ICOL (1 << 4)
+#define CMDLINE_FLAG_DELIM (1 << 5)
+#define CMDLINE_FLAG_OFORMAT (1 << 6)
+#define CMDLINE_FLAG_FLEN (1 << 7)
+#define CMDLINE_FLAG_TAPS (1 << 8)
+#define CMDLINE_FLAG_BLOCK (1 << 9)
+#define CMDLINE_FLAG_IIR (1 << 10)
+#define CMDLINE_FLAG_THREADS (1 << 11)
   uint32_t flags;
 
   double fsampl;
@@ -152,7 +406,31 @@ typedef struct
   const char* ifile;
   const char* ofile;
 
-  size_t icol;
+  /* input columns, 0 for all of them */
+#define CMDLINE_MAX_ICOLS 64
+  size_t icols[CMDLINE_MAX_ICOLS];
+  size_t nicol;
+
+  csv_opts_t csv_opts;
+
+  /* CSV_WRITER_xxx */
+  int oformat;
+
+  /* transform length policy */
+#define FLEN_EXACT 0
+#define FLEN_PAD 1
+#define FLEN_CROP 2
+  int flen;
+
+  /* streaming finite kernel length, and input block size */
+  size_t ntap;
+  size_t nblock;
+
+  /* streaming biquad cascade, butterworth order of cut bands */
+  size_t iir_order;
+
+  /* column workers, 0 for cpu count */
+  size_t nthread;
 
 } cmdline_info_t;
 
@@ -178,19 +456,45 @@ static int str_to_tuple(const char* s, double* t, size_t n)
   return 0;
 }
 
+static int str_to_icols(const char* s, size_t* icols, size_t* n)
+{
+  /* comma separated column list, ie. 1,2,3 */
+
+  char* p;
+
+  for (*n = 0; *n != CMDLINE_MAX_ICOLS; ++*n)
+  {
+    icols[*n] = (size_t)strtoul(s, &p, 0);
+    if (p == s) return -1;
+    if (*p == 0) { ++*n; return 0; }
+    if (*p != ',') return -1;
+    s = p + 1;
+  }
+
+  return -1;
+}
+
 static int get_cmdline_info(cmdline_info_t* ci, int ac, char** av)
 {
   node_t* node;
   size_t i;
 
-  if (ac & 1) goto on_error;
-
   ci->flags = 0;
   ci->fsampl = 0;
   ci->filters = NULL;
   ci->ifile = NULL;
   ci->ofile = NULL;
-  ci->icol = 0;
+  ci->nicol = 0;
+  ci->csv_opts.delims = NULL;
+  ci->oformat = CSV_WRITER_TEXT;
+  ci->flen = FLEN_EXACT;
+  ci->ntap = 0;
+  ci->nblock = 0;
+  ci->iir_order = 0;
+  ci->nthread = 0;
+
+  /* after defaults, the filter list being freed on error */
+  if (ac & 1) goto on_error;
 
   for (i = 0; i != ac; i += 2)
   {
@@ -231,9 +535,61 @@ static int get_cmdline_info(cmdline_info_t* ci, int ac, char** av)
     }
     else if (strcmp(k, "-icol") == 0)
     {
-      /* input column */
+      /* input columns, ie. 1,2,3 or all */
       ci->flags |= CMDLINE_FLAG_ICOL;
-      ci->icol = (size_t)str_to_double(v);
+      if (strcmp(v, "all") == 0) ci->nicol = 0;
+      else if (str_to_icols(v, ci->icols, &ci->nicol)) goto on_error;
+    }
+    else if (strcmp(k, "-threads") == 0)
+    {
+      /* column workers, 0 for cpu count */
+      ci->flags |= CMDLINE_FLAG_THREADS;
+      ci->nthread = (size_t)str_to_double(v);
+    }
+    else if (strcmp(k, "-delim") == 0)
+    {
+      /* csv field delimiters, ie. "," or $'\t' */
+      ci->flags |= CMDLINE_FLAG_DELIM;
+      ci->csv_opts.delims = v;
+    }
+    else if (strcmp(k, "-oformat") == 0)
+    {
+      /* text or bin, bin being native doubles */
+      ci->flags |= CMDLINE_FLAG_OFORMAT;
+      if (strcmp(v, "text") == 0) ci->oformat = CSV_WRITER_TEXT;
+      else if (strcmp(v, "bin") == 0) ci->oformat = CSV_WRITER_BINARY;
+      else goto on_error;
+    }
+    else if (strcmp(k, "-flen") == 0)
+    {
+      /* exact, or pad or crop to a size with small prime factors */
+      ci->flags |= CMDLINE_FLAG_FLEN;
+      if (strcmp(v, "exact") == 0) ci->flen = FLEN_EXACT;
+      else if (strcmp(v, "pad") == 0) ci->flen = FLEN_PAD;
+      else if (strcmp(v, "crop") == 0) ci->flen = FLEN_CROP;
+      else goto on_error;
+    }
+    else if (strcmp(k, "-taps") == 0)
+    {
+      /* stream with a finite kernel of this length, made odd */
+      const double x = str_to_double(v);
+      ci->flags |= CMDLINE_FLAG_TAPS;
+      if (x < 3) goto on_error;
+      ci->ntap = (size_t)x | 1;
+    }
+    else if (strcmp(k, "-iir") == 0)
+    {
+      /* stream with biquad sections instead of a finite kernel */
+      ci->flags |= CMDLINE_FLAG_IIR;
+      ci->iir_order = (size_t)str_to_double(v);
+      if (ci->iir_order == 0) goto on_error;
+    }
+    else if (strcmp(k, "-block") == 0)
+    {
+      /* streaming input block size, in samples */
+      ci->flags |= CMDLINE_FLAG_BLOCK;
+      ci->nblock = (size_t)str_to_double(v);
+      if (ci->nblock == 0) goto on_error;
     }
     else
     {
@@ -250,6 +606,388 @@ static int get_cmdline_info(cmdline_info_t* ci, int ac, char** av)
   return -1;
 }
 
+/* streaming mode. the input is read by blocks of nblock samples and
+   convolved with the finite kernel using overlap add: each block is
+   transformed with ntap - 1 zeros, the tail of its convolution being
+   added to the next one. memory is O(nblock), output starts with the
+   first block. outputs are shifted by the kernel delay so that rows
+   line up with the input, as with the bin wise filter.
+ */
+
+#define OLA_DEFAULT_FACTOR 4
+
+typedef struct ola
+{
+  size_t ntap;
+  size_t nblock;
+  size_t nfft;
+  size_t nbin;
+  size_t delay;
+
+  /* kernel spectrum, normalized */
+  fftw_complex* hh;
+
+  /* transform buffers, and the tail added to the next block */
+  double* in;
+  fftw_complex* out;
+  double* y;
+  double* tail;
+
+  /* the delay previous inputs, then the current block ones */
+  double* hist;
+
+  fftw_plan fwd;
+  fftw_plan bwd;
+
+  /* output row index, minus the delay */
+  size_t pos;
+
+} ola_t;
+
+static int ola_init(ola_t* ola, const cmdline_info_t* ci)
+{
+  fftw_plan plan;
+  double* h;
+  size_t i;
+
+  ola->ntap = ci->ntap;
+  ola->delay = (ola->ntap - 1) / 2;
+
+  /* the transform holds a block and the kernel, with small factors */
+  if (ci->flags & CMDLINE_FLAG_BLOCK)
+  {
+    ola->nfft = czt_next_size(ci->nblock + ola->ntap - 1);
+  }
+  else
+  {
+    ola->nfft = czt_next_size(OLA_DEFAULT_FACTOR * ola->ntap);
+  }
+  ola->nblock = ola->nfft - (ola->ntap - 1);
+  ola->nbin = ola->nfft / 2 + 1;
+  ola->pos = 0;
+
+  ola->hh = fftw_malloc(ola->nbin * sizeof(fftw_complex));
+  if (ola->hh == NULL) goto on_error_0;
+
+  ola->out = fftw_malloc(ola->nbin * sizeof(fftw_complex));
+  if (ola->out == NULL) goto on_error_1;
+
+  /* in, y, then tail and hist, in one block */
+  ola->in = fftw_malloc
+  ((2 * ola->nfft + ola->ntap + ola->delay + ola->nblock) * sizeof(double));
+  if (ola->in == NULL) goto on_error_2;
+  ola->y = ola->in + ola->nfft;
+  ola->tail = ola->y + ola->nfft;
+  ola->hist = ola->tail + ola->ntap;
+
+  memset(ola->tail, 0, (ola->ntap + ola->delay) * sizeof(double));
+
+  /* kernel spectrum */
+
+  h = ola->in;
+  memset(h, 0, ola->nfft * sizeof(double));
+  if (make_kernel(h, ola->ntap, ci->fsampl, ci->filters)) goto on_error_3;
+
+  plan = fftw_plan_dft_r2c_1d((int)ola->nfft, h, ola->hh, FFTW_ESTIMATE);
+  if (plan == NULL) goto on_error_3;
+  fftw_execute(plan);
+  fftw_destroy_plan(plan);
+
+  for (i = 0; i != ola->nbin; ++i)
+  {
+    ola->hh[i][0] /= (double)ola->nfft;
+    ola->hh[i][1] /= (double)ola->nfft;
+  }
+
+  ola->fwd = fftw_plan_dft_r2c_1d
+    ((int)ola->nfft, ola->in, ola->out, FFTW_ESTIMATE);
+  if (ola->fwd == NULL) goto on_error_3;
+
+  ola->bwd = fftw_plan_dft_c2r_1d
+    ((int)ola->nfft, ola->out, ola->y, FFTW_ESTIMATE);
+  if (ola->bwd == NULL) goto on_error_4;
+
+  return 0;
+
+ on_error_4:
+  fftw_destroy_plan(ola->fwd);
+ on_error_3:
+  fftw_free(ola->in);
+ on_error_2:
+  fftw_free(ola->out);
+ on_error_1:
+  fftw_free(ola->hh);
+ on_error_0:
+  return -1;
+}
+
+static void ola_fini(ola_t* ola)
+{
+  fftw_destroy_plan(ola->bwd);
+  fftw_destroy_plan(ola->fwd);
+  fftw_free(ola->in);
+  fftw_free(ola->out);
+  fftw_free(ola->hh);
+}
+
+static void ola_block(ola_t* ola, size_t n, int is_last, csv_writer_t* w)
+{
+  /* filter the n samples in hist + delay, n < nblock if is_last */
+  /* the last block also outputs the delay pending samples */
+
+  const size_t nk = ola->ntap - 1;
+  double* const x = ola->hist + ola->delay;
+  size_t nout;
+  size_t i;
+
+  memcpy(ola->in, x, n * sizeof(double));
+  memset(ola->in + n, 0, (ola->nfft - n) * sizeof(double));
+
+  fftw_execute(ola->fwd);
+
+  for (i = 0; i != ola->nbin; ++i)
+  {
+    const double re = ola->out[i][0];
+    const double im = ola->out[i][1];
+    ola->out[i][0] = re * ola->hh[i][0] - im * ola->hh[i][1];
+    ola->out[i][1] = re * ola->hh[i][1] + im * ola->hh[i][0];
+  }
+
+  fftw_execute(ola->bwd);
+
+  for (i = 0; i != nk; ++i) ola->y[i] += ola->tail[i];
+
+  /* full convolution sample m is the output of input m - delay */
+
+  nout = is_last ? (n + ola->delay) : n;
+
+  for (i = 0; i != nout; ++i, ++ola->pos)
+  {
+    if (ola->pos < ola->delay) continue ;
+    csv_writer_put(w, (double)(ola->pos - ola->delay));
+    csv_writer_put(w, ola->hist[i]);
+    csv_writer_put(w, ola->y[i]);
+    csv_writer_endl(w);
+  }
+
+  memcpy(ola->tail, ola->y + n, nk * sizeof(double));
+  memmove(ola->hist, ola->hist + n, ola->delay * sizeof(double));
+}
+
+/* streaming biquad cascade, designed from the filter list. unlike
+   the bin wise filter, bands multiply where they overlap. the output
+   is not delay compensated, an iir filter having no constant delay.
+ */
+
+#define IIR_DEFAULT_BLOCK 4096
+
+typedef struct iir
+{
+  biquad_t bq;
+  size_t nblock;
+
+  /* block input, filtered output */
+  double* x;
+  double* y;
+
+  /* output row index */
+  size_t pos;
+
+} iir_t;
+
+static int iir_init(iir_t* iir, const cmdline_info_t* ci)
+{
+  const node_t* pos;
+
+  if (biquad_init(&iir->bq, 1)) goto on_error_0;
+
+  for (pos = ci->filters; pos; pos = pos->next)
+  {
+    if (biquad_add_band
+	(
+	 &iir->bq, ci->fsampl,
+	 pos->triple[0], pos->triple[1], pos->triple[2],
+	 ci->iir_order
+	))
+      goto on_error_0;
+  }
+
+  iir->nblock = IIR_DEFAULT_BLOCK;
+  if (ci->flags & CMDLINE_FLAG_BLOCK) iir->nblock = ci->nblock;
+  iir->pos = 0;
+
+  iir->x = malloc(2 * iir->nblock * sizeof(double));
+  if (iir->x == NULL) goto on_error_0;
+  iir->y = iir->x + iir->nblock;
+
+  return 0;
+
+ on_error_0:
+  return -1;
+}
+
+static void iir_fini(iir_t* iir)
+{
+  free(iir->x);
+}
+
+static void iir_block(iir_t* iir, size_t n, csv_writer_t* w)
+{
+  size_t i;
+
+  memcpy(iir->y, iir->x, n * sizeof(double));
+  biquad_run(&iir->bq, iir->y, n);
+
+  for (i = 0; i != n; ++i, ++iir->pos)
+  {
+    csv_writer_put(w, (double)iir->pos);
+    csv_writer_put(w, iir->x[i]);
+    csv_writer_put(w, iir->y[i]);
+    csv_writer_endl(w);
+  }
+}
+
+static int do_stream(const cmdline_info_t* ci)
+{
+  /* ifile is read as a stream, the selected range being skipped to */
+
+  const int is_iir = (ci->flags & CMDLINE_FLAG_IIR) ? 1 : 0;
+  int err = -1;
+  csv_stream_t icsv;
+  csv_writer_t ocsv;
+  ola_t ola;
+  iir_t iir;
+  double* blk;
+  size_t nblock;
+  double* cols;
+  const double* x;
+  size_t nline;
+  size_t pos;
+  size_t lo;
+  size_t hi;
+  size_t n;
+  size_t i;
+
+  /* blk the current block samples */
+
+  if (is_iir)
+  {
+    if (iir_init(&iir, ci))
+    {
+      PERROR();
+      goto on_error_0;
+    }
+
+    blk = iir.x;
+    nblock = iir.nblock;
+
+    fprintf
+    (
+     stderr, "iir %zu sections, block %zu\n",
+     iir.bq.nsect, iir.nblock
+    );
+  }
+  else
+  {
+    if (ola_init(&ola, ci))
+    {
+      PERROR();
+      goto on_error_0;
+    }
+
+    blk = ola.hist + ola.delay;
+    nblock = ola.nblock;
+
+    fprintf
+    (
+     stderr, "kernel %zu taps, block %zu, fft length %zu\n",
+     ola.ntap, ola.nblock, ola.nfft
+    );
+  }
+
+  if (csv_stream_open(&icsv, ci->ifile, &ci->csv_opts))
+  {
+    PERROR();
+    goto on_error_1;
+  }
+
+  if (ci->icols[0] >= icsv.ncol)
+  {
+    PERROR();
+    goto on_error_2;
+  }
+
+  cols = malloc(icsv.ncol * nblock * sizeof(double));
+  if (cols == NULL)
+  {
+    PERROR();
+    goto on_error_2;
+  }
+
+  if (csv_writer_open(&ocsv, ci->ofile, ci->oformat))
+  {
+    PERROR();
+    goto on_error_3;
+  }
+
+  lo = 0;
+  hi = (size_t)-1;
+  if (ci->flags & CMDLINE_FLAG_TSAMPL)
+  {
+    lo = (size_t)floor(ci->tsampl[0] * ci->fsampl);
+    hi = lo + (size_t)ceil((ci->tsampl[1] - ci->tsampl[0]) * ci->fsampl);
+  }
+
+  /* n the samples in the current block */
+
+  n = 0;
+
+  for (pos = 0; pos < hi; )
+  {
+    if (csv_stream_read(&icsv, cols, nblock, &nline))
+    {
+      PERROR();
+      goto on_error_4;
+    }
+
+    if (nline == 0) break ;
+
+    x = cols + ci->icols[0] * nblock;
+
+    for (i = 0; (i != nline) && (pos < hi); ++i, ++pos)
+    {
+      if (pos < lo) continue ;
+
+      blk[n++] = x[i];
+      if (n != nblock) continue ;
+
+      if (is_iir) iir_block(&iir, n, &ocsv);
+      else ola_block(&ola, n, 0, &ocsv);
+      n = 0;
+    }
+  }
+
+  /* last block, possibly empty, and the delayed outputs */
+
+  if (is_iir) iir_block(&iir, n, &ocsv);
+  else ola_block(&ola, n, 1, &ocsv);
+
+  err = 0;
+
+ on_error_4:
+  if (csv_writer_close(&ocsv)) err = -1;
+ on_error_3:
+  free(cols);
+ on_error_2:
+  csv_stream_close(&icsv);
+ on_error_1:
+  if (is_iir) iir_fini(&iir);
+  else ola_fini(&ola);
+ on_error_0:
+  return err;
+}
+
+
 /* main */
 
 int main(int ac, char** av)
@@ -257,16 +995,25 @@ int main(int ac, char** av)
   int err = -1;
   cmdline_info_t ci;
   csv_handle_t icsv;
+  csv_writer_t ocsv;
+  pool_t pool;
+  filter_worker_t* workers;
+  filter_job_t job;
+  const double** cols;
   double fband;
   size_t nbin;
   double* xx;
   double* coeffs;
   double* x;
   size_t nx;
+  size_t nthread;
   size_t i;
   size_t j;
   size_t k;
   size_t n;
+  size_t nfft;
+  int is_czt;
+  long ncpu;
   node_t* pos;
 
   if (get_cmdline_info(&ci, ac - 1, av + 1))
@@ -281,98 +1028,219 @@ int main(int ac, char** av)
     goto on_error_0;
   }
 
-  if (csv_load_file(&icsv, ci.ifile))
+  if ((ci.flags & CMDLINE_FLAG_ICOL) == 0)
   {
     PERROR();
     goto on_error_0;
   }
 
-  if ((ci.flags & CMDLINE_FLAG_ICOL) == 0)
+  if ((ci.flags & CMDLINE_FLAG_FSAMPL) == 0)
   {
     PERROR();
-    goto on_error_1;
+    goto on_error_0;
   }
 
-  if (csv_get_col(&icsv, ci.icol, &x, &nx))
+  if (ci.flags & (CMDLINE_FLAG_TAPS | CMDLINE_FLAG_IIR))
   {
-    PERROR();
-    goto on_error_1;
+    /* single column */
+    if (ci.nicol != 1)
+    {
+      PERROR();
+      goto on_error_0;
+    }
+
+    err = do_stream(&ci);
+    goto on_error_0;
   }
 
-  /* default tsampl_lo tsampl_hi */
+  /* compute sample range */
 
-  if ((ci.flags & CMDLINE_FLAG_FSAMPL) == 0)
+  if (ci.flags & CMDLINE_FLAG_TSAMPL)
   {
-    PERROR();
-    goto on_error_1;
+    /* only load the selected lines, using the line index */
+    i = (size_t)floor(ci.tsampl[0] * ci.fsampl);
+    n = (size_t)ceil((ci.tsampl[1] - ci.tsampl[0]) * ci.fsampl);
+    if (csv_load_lines(&icsv, ci.ifile, &ci.csv_opts, i, n))
+    {
+      PERROR();
+      goto on_error_0;
+    }
+    i = 0;
   }
-
-  if ((ci.flags & CMDLINE_FLAG_TSAMPL) == 0)
+  else
   {
-    ci.flags |= CMDLINE_FLAG_TSAMPL;
-    ci.tsampl[0] = 0.0;
-    ci.tsampl[1] = ci.fsampl * (double)nx;
+    if (csv_load_file(&icsv, ci.ifile, &ci.csv_opts))
+    {
+      PERROR();
+      goto on_error_0;
+    }
+    i = 0;
+    n = icsv.nline;
   }
 
-  /* recompute sample count */
+  /* all columns */
 
-  i = (size_t)floor(ci.tsampl[0] * ci.fsampl);
-  if (i >= nx)
+  if (ci.nicol == 0)
   {
-    PERROR();
-    goto on_error_1;
+    if (icsv.ncol > CMDLINE_MAX_ICOLS)
+    {
+      PERROR();
+      goto on_error_1;
+    }
+
+    for (j = 0; j != icsv.ncol; ++j) ci.icols[j] = j;
+    ci.nicol = icsv.ncol;
   }
 
-  n = (size_t)ceil((ci.tsampl[1] - ci.tsampl[0]) * ci.fsampl);
-  if ((i + n) > nx)
+  cols = malloc(ci.nicol * sizeof(const double*));
+  if (cols == NULL)
   {
     PERROR();
     goto on_error_1;
   }
 
-  fband = nsampl_to_fband(n, ci.fsampl);
+  for (j = 0; j != ci.nicol; ++j)
+  {
+    if (csv_get_col(&icsv, ci.icols[j], &x, &nx))
+    {
+      PERROR();
+      goto on_error_2;
+    }
+
+    if ((i >= nx) || ((i + n) > nx))
+    {
+      PERROR();
+      goto on_error_2;
+    }
+
+    cols[j] = x + i;
+  }
+
+  /* transform length. padding also keeps the circular convolution
+     from wrapping the output end over its start. */
+
+  nfft = n;
+  if (ci.flen == FLEN_PAD) nfft = czt_next_size(n);
+  else if (ci.flen == FLEN_CROP) nfft = czt_prev_size(n);
+
+  is_czt = (czt_max_factor(nfft) > CZT_SLOW_FACTOR);
+
+  fband = nsampl_to_fband(nfft, ci.fsampl);
 
-  nbin = n / 2 + 1;
+  /* no more workers than columns */
+
+  nthread = ci.nthread;
+  if (nthread == 0)
+  {
+    ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    nthread = (ncpu < 1) ? 1 : (size_t)ncpu;
+  }
+  if (nthread > ci.nicol) nthread = ci.nicol;
+
+  fprintf
+  (
+   stderr, "fft length %zu (%zu samples), bin spacing %g hz%s\n",
+   nfft, n, fband, is_czt ? ", chirp z" : ""
+  );
+
+  /* cropped, the remaining samples are ignored */
+  if (nfft < n) n = nfft;
+
+  nbin = nfft / 2 + 1;
 
   /* build filtering coeff array */
 
   coeffs = malloc(nbin * sizeof(double));
-  if (coeffs == NULL) goto on_error_1;
+  if (coeffs == NULL) goto on_error_2;
 
-  for (j = 0; j != nbin; ++j) coeffs[j] = 1.0;
+  if (make_coeffs(coeffs, nbin, fband, ci.filters)) goto on_error_3;
+
+  /* output, one column after the other */
 
-  for (pos = ci.filters; pos; pos = pos->next)
+  xx = malloc(ci.nicol * n * sizeof(double));
+  if (xx == NULL)
   {
-    if (pos->triple[0] < 0) goto on_error_2;
-    if (pos->triple[1] > ((double)nbin * fband)) goto on_error_2;
-    if (pos->triple[0] > pos->triple[1]) goto on_error_2;
+    PERROR();
+    goto on_error_3;
+  }
 
-    j = floor(pos->triple[0] / fband);
-    k = ceil(pos->triple[1] / fband);
-    if (k > nbin) k = nbin;
-    for (; j != k; ++j) coeffs[j] = pos->triple[2];
+  if (pool_create(&pool, nthread))
+  {
+    PERROR();
+    goto on_error_4;
   }
 
-  /* output */
+  workers = malloc(pool.nthread * sizeof(filter_worker_t));
+  if (workers == NULL)
+  {
+    PERROR();
+    goto on_error_5;
+  }
 
-  xx = malloc(n * sizeof(double));
-  if (xx == NULL)
+  for (k = 0; k != pool.nthread; ++k)
+  {
+    if (filter_worker_init(&workers[k], nfft, is_czt))
+    {
+      PERROR();
+      goto on_error_6;
+    }
+  }
+
+  job.workers = workers;
+  job.coeffs = coeffs;
+  job.x = cols;
+  job.xx = xx;
+  job.n = n;
+  job.nfft = nfft;
+
+  if (pool_run(&pool, filter_task, &job, ci.nicol))
   {
     PERROR();
-    goto on_error_2;
+    goto on_error_6;
   }
 
-  filter(xx, x + i, n, coeffs);
+  /* ofile defaults to stdout. index, then input and filtered values
+     of each column. */
 
-  for (j = 0; j != n; ++j)
+  if (csv_writer_open(&ocsv, ci.ofile, ci.oformat))
   {
-    printf("%zu %lf %lf\n", j, x[i + j], xx[j]);
+    PERROR();
+    goto on_error_6;
+  }
+
+  for (i = 0; i != n; ++i)
+  {
+    csv_writer_put(&ocsv, (double)i);
+    for (j = 0; j != ci.nicol; ++j)
+    {
+      csv_writer_put(&ocsv, cols[j][i]);
+      csv_writer_put(&ocsv, xx[j * n + i]);
+    }
+    csv_writer_endl(&ocsv);
+  }
+
+  if (csv_writer_close(&ocsv))
+  {
+    PERROR();
+    goto on_error_6;
   }
 
   err = 0;
 
+ on_error_6:
+  while (k--) filter_worker_fini(&workers[k]);
+  free(workers);
+ on_error_5:
+  pool_destroy(&pool);
+ on_error_4:
   free(xx);
+ on_error_3:
+  free(coeffs);
  on_error_2:
+  free(cols);
+ on_error_1:
+  csv_close(&icsv);
+ on_error_0:
   pos = ci.filters;
   while (pos != NULL)
   {
@@ -380,9 +1248,5 @@ int main(int ac, char** av)
     pos = pos->next;
     free(tmp);
   }
-  free(coeffs);
- on_error_1:
-  csv_close(&icsv);
- on_error_0:
   return err;
 }